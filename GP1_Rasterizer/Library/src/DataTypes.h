@@ -1,5 +1,5 @@
 #pragma once
-#include <memory>
+#include <vector>
 
 #include "Maths.h"
 #include "Texture.h"
@@ -17,6 +17,84 @@ namespace dae
 		ColorRGB color{colors::White};
 	};
 
+	// The vertex stage handles this many vertices at once, vertex arrays are padded to a multiple of it
+	constexpr size_t VERTEX_BATCH_SIZE{ 4 };
+
+	inline size_t GetPaddedVertexCount(size_t count)
+	{
+		return (count + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE * VERTEX_BATCH_SIZE;
+	}
+
+	// Vertices of a mesh in model space, every component has its own array and vertex i is element i of each
+	struct VertexBuffer
+	{
+		std::vector<float> positionX{};
+		std::vector<float> positionY{};
+		std::vector<float> positionZ{};
+		std::vector<float> normalX{};
+		std::vector<float> normalY{};
+		std::vector<float> normalZ{};
+		std::vector<float> tangentX{};
+		std::vector<float> tangentY{};
+		std::vector<float> tangentZ{};
+		std::vector<Vector2> uv{};
+		size_t count{};
+
+		size_t GetSize() const { return count; }
+
+		void Resize(size_t size)
+		{
+			count = size;
+
+			for (std::vector<float>* component : { &positionX, &positionY, &positionZ, &normalX, &normalY, &normalZ, &tangentX, &tangentY, &tangentZ })
+				component->resize(GetPaddedVertexCount(size));
+
+			uv.resize(size);
+		}
+	};
+
+	// Output of the vertex stage, laid out the same way as the model vertices
+	struct TransformedVertexBuffer
+	{
+		// Screen x and y, inverse of the NDC depth and the view depth w
+		std::vector<float> positionX{};
+		std::vector<float> positionY{};
+		std::vector<float> positionZ{};
+		std::vector<float> positionW{};
+
+		// Clip space before the divide, w is the same as positionW
+		std::vector<float> clipX{};
+		std::vector<float> clipY{};
+		std::vector<float> clipZ{};
+
+		// One bit per clip plane the vertex is outside of
+		std::vector<uint32_t> outcodes{};
+
+		// World space, used for lighting
+		std::vector<float> worldX{};
+		std::vector<float> worldY{};
+		std::vector<float> worldZ{};
+		std::vector<float> normalX{};
+		std::vector<float> normalY{};
+		std::vector<float> normalZ{};
+		std::vector<float> tangentX{};
+		std::vector<float> tangentY{};
+		std::vector<float> tangentZ{};
+		std::vector<float> viewDirectionX{};
+		std::vector<float> viewDirectionY{};
+		std::vector<float> viewDirectionZ{};
+
+		void Resize(size_t size)
+		{
+			for (std::vector<float>* component : { &positionX, &positionY, &positionZ, &positionW, &clipX, &clipY, &clipZ, &worldX, &worldY, &worldZ,
+				&normalX, &normalY, &normalZ, &tangentX, &tangentY, &tangentZ, &viewDirectionX, &viewDirectionY, &viewDirectionZ })
+				component->resize(GetPaddedVertexCount(size));
+
+			outcodes.resize(GetPaddedVertexCount(size));
+		}
+	};
+
+	// One vertex of a triangle gathered from the transformed arrays, only lives while the triangle is rasterized
 	struct VertexTransformed
 	{
 		Vector3 worldPos{};
@@ -25,17 +103,9 @@ namespace dae
 		Vector3 normal{};
 		Vector3 tangent{};
 		Vector3 viewDirection{};
-		int materialIndex{ 0 };
 		ColorRGB color{ colors::White };
 	};
 
-	struct Triangle
-	{
-		std::shared_ptr<VertexTransformed> vertex0;
-		std::shared_ptr<VertexTransformed> vertex1;
-	 	std::shared_ptr<VertexTransformed> vertex2;
-	};
-
 
 	enum class PrimitiveTopology
 	{
@@ -46,10 +116,11 @@ namespace dae
 	struct Material
 	{
 		Texture* diffuse = nullptr;
-		Texture* opacity = nullptr;
 		Texture* normal = nullptr;
-		Texture* specular = nullptr;
-		Texture* gloss = nullptr;
+
+		// Specular in red, gloss in green and opacity in blue, see Texture::LoadPacked
+		Texture* surface = nullptr;
+		bool hasOpacity = false; // Without an opacity map the blue channel is white, so the cutout test can be skipped
 
 		ColorRGB diffuseColor{}; // Used when there is no diffuse texture in use
 	};
@@ -0,0 +1,155 @@
+#include "PixelResolver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+#include <SDL_pixels.h>
+
+namespace dae
+{
+	PixelResolver::PixelResolver()
+	{
+		BuildLookupTable();
+	}
+
+	void PixelResolver::SetFormat(const SDL_PixelFormat* pFormat)
+	{
+		if (pFormat == m_pFormat)
+			return;
+
+		m_pFormat = pFormat;
+		m_CanPack = pFormat->BytesPerPixel == 4 && pFormat->Rloss == 0 && pFormat->Gloss == 0 && pFormat->Bloss == 0;
+
+		m_RedShift = pFormat->Rshift;
+		m_GreenShift = pFormat->Gshift;
+		m_BlueShift = pFormat->Bshift;
+
+		// SDL_MapRGB makes pixels fully opaque, so the same is done here
+		m_AlphaMask = pFormat->Amask;
+	}
+
+	void PixelResolver::ToggleToneMapping()
+	{
+		m_ToneMappingEnabled = !m_ToneMappingEnabled;
+		BuildLookupTable();
+	}
+
+	void PixelResolver::ToggleGammaCorrection()
+	{
+		m_GammaCorrectionEnabled = !m_GammaCorrectionEnabled;
+		BuildLookupTable();
+	}
+
+	void PixelResolver::ResolveRow(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pPixels, int pixelCount) const
+	{
+		int pixelIndex{};
+
+		if (m_CanPack)
+		{
+			const bool useLookup{ m_ToneMappingEnabled || m_GammaCorrectionEnabled };
+
+			const __m128 zero{ _mm_setzero_ps() };
+			const __m128 one{ _mm_set1_ps(1.0f) };
+			const __m128 half{ _mm_set1_ps(0.5f) };
+			const __m128 range{ _mm_set1_ps(m_LookupRange) };
+			const __m128 scale{ _mm_set1_ps(useLookup ? static_cast<float>(LOOKUP_SIZE - 1) / m_LookupRange : 255.0f) };
+
+			const __m128i redShift{ _mm_cvtsi32_si128(static_cast<int>(m_RedShift)) };
+			const __m128i greenShift{ _mm_cvtsi32_si128(static_cast<int>(m_GreenShift)) };
+			const __m128i blueShift{ _mm_cvtsi32_si128(static_cast<int>(m_BlueShift)) };
+			const __m128i alphaMask{ _mm_set1_epi32(static_cast<int>(m_AlphaMask)) };
+
+			// Lookups have no vector instruction without AVX2, so the indices go through memory
+			const auto toBytes = [&](__m128 channel)
+			{
+				channel = _mm_min_ps(_mm_max_ps(channel, zero), range);
+
+				if (!useLookup)
+					return _mm_cvttps_epi32(_mm_mul_ps(channel, scale));
+
+				alignas(16) int32_t indices[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(indices), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(channel, scale), half)));
+
+				return _mm_setr_epi32(m_LookupTable[indices[0]], m_LookupTable[indices[1]], m_LookupTable[indices[2]], m_LookupTable[indices[3]]);
+			};
+
+			for (; pixelIndex + 4 <= pixelCount; pixelIndex += 4)
+			{
+				__m128 red{ _mm_loadu_ps(pRed + pixelIndex) };
+				__m128 green{ _mm_loadu_ps(pGreen + pixelIndex) };
+				__m128 blue{ _mm_loadu_ps(pBlue + pixelIndex) };
+
+				// Same as MaxToOne, dividing by one leaves colors that are not too bright untouched
+				if (!m_ToneMappingEnabled)
+				{
+					const __m128 divisor{ _mm_max_ps(_mm_max_ps(red, _mm_max_ps(green, blue)), one) };
+					red = _mm_div_ps(red, divisor);
+					green = _mm_div_ps(green, divisor);
+					blue = _mm_div_ps(blue, divisor);
+				}
+
+				__m128i pixels{ _mm_or_si128(_mm_sll_epi32(toBytes(red), redShift), _mm_sll_epi32(toBytes(green), greenShift)) };
+				pixels = _mm_or_si128(pixels, _mm_sll_epi32(toBytes(blue), blueShift));
+				pixels = _mm_or_si128(pixels, alphaMask);
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pPixels + pixelIndex), pixels);
+			}
+		}
+
+		// Rows that are not a multiple of four, and formats that can't be packed
+		for (; pixelIndex < pixelCount; ++pixelIndex)
+			pPixels[pixelIndex] = ResolvePixel(pRed[pixelIndex], pGreen[pixelIndex], pBlue[pixelIndex]);
+	}
+
+	void PixelResolver::BuildLookupTable()
+	{
+		m_LookupRange = m_ToneMappingEnabled ? TONE_MAP_WHITE : 1.0f;
+		m_LookupTable.resize(LOOKUP_SIZE);
+
+		for (int index{}; index < LOOKUP_SIZE; ++index)
+		{
+			float value{ static_cast<float>(index) / (LOOKUP_SIZE - 1) * m_LookupRange };
+
+			// Extended Reinhard, TONE_MAP_WHITE ends up at exactly one
+			if (m_ToneMappingEnabled)
+				value = value * (1.0f + value / (TONE_MAP_WHITE * TONE_MAP_WHITE)) / (1.0f + value);
+
+			// Linear to sRGB
+			if (m_GammaCorrectionEnabled)
+				value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+
+			m_LookupTable[index] = static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+	}
+
+	uint32_t PixelResolver::ResolvePixel(float red, float green, float blue) const
+	{
+		if (!m_ToneMappingEnabled)
+		{
+			const float maxValue{ std::max(red, std::max(green, blue)) };
+			if (maxValue > 1.0f)
+			{
+				red /= maxValue;
+				green /= maxValue;
+				blue /= maxValue;
+			}
+		}
+
+		const bool useLookup{ m_ToneMappingEnabled || m_GammaCorrectionEnabled };
+		const auto toByte = [&](float channel) -> uint8_t
+		{
+			channel = std::clamp(channel, 0.0f, m_LookupRange);
+
+			if (!useLookup)
+				return static_cast<uint8_t>(channel * 255.0f);
+
+			return m_LookupTable[static_cast<int>(channel * (static_cast<float>(LOOKUP_SIZE - 1) / m_LookupRange) + 0.5f)];
+		};
+
+		if (!m_CanPack)
+			return SDL_MapRGB(m_pFormat, toByte(red), toByte(green), toByte(blue));
+
+		return static_cast<uint32_t>(toByte(red)) << m_RedShift | static_cast<uint32_t>(toByte(green)) << m_GreenShift | static_cast<uint32_t>(toByte(blue)) << m_BlueShift | m_AlphaMask;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+struct SDL_PixelFormat;
+
+namespace dae
+{
+	// Turns float colors into pixels of an SDL surface, four pixels at a time
+	// Without tone mapping colors are scaled down like ColorRGB::MaxToOne, with it every channel is compressed
+	class PixelResolver final
+	{
+	public:
+		PixelResolver();
+		~PixelResolver() = default;
+
+		PixelResolver(const PixelResolver&) = delete;
+		PixelResolver(PixelResolver&&) noexcept = delete;
+		PixelResolver& operator=(const PixelResolver&) = delete;
+		PixelResolver& operator=(PixelResolver&&) noexcept = delete;
+
+		// Reads where every channel goes in a pixel, once per frame is enough
+		void SetFormat(const SDL_PixelFormat* pFormat);
+
+		void ToggleToneMapping();
+		void ToggleGammaCorrection();
+		bool IsToneMappingEnabled() const { return m_ToneMappingEnabled; }
+		bool IsGammaCorrectionEnabled() const { return m_GammaCorrectionEnabled; }
+
+		// Colors are given per channel, can be called from multiple threads for different rows
+		void ResolveRow(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pPixels, int pixelCount) const;
+
+	private:
+		void BuildLookupTable();
+		uint32_t ResolvePixel(float red, float green, float blue) const;
+
+		// Only used when tone mapping or gamma correction is on, otherwise channels are scaled to bytes directly
+		static constexpr int LOOKUP_SIZE{ 4096 };
+		static constexpr float TONE_MAP_WHITE{ 4.0f };	// Brightness that becomes full white after tone mapping
+
+		const SDL_PixelFormat* m_pFormat{};
+
+		// Formats with 8 bits per channel are packed with shifts, anything else goes through SDL_MapRGB
+		bool m_CanPack{ false };
+		uint32_t m_RedShift{};
+		uint32_t m_GreenShift{};
+		uint32_t m_BlueShift{};
+		uint32_t m_AlphaMask{};
+
+		bool m_ToneMappingEnabled{ false };
+		bool m_GammaCorrectionEnabled{ false };
+		float m_LookupRange{ 1.0f };
+		std::vector<uint8_t> m_LookupTable{};
+	};
+}
@@ -1,7 +1,10 @@
 #include "Texture.h"
 
 #include <algorithm>
+#include <bit>
+#include <cmath>
 #include <format>
+#include <immintrin.h>
 #include <iostream>
 #include <SDL_image.h>
 
@@ -11,22 +14,146 @@
 namespace dae
 {
 
-	Texture::Texture(SDL_Surface* pSurface) :
-		m_SurfacePtr{ pSurface },
-		m_SurfacePixelsPtr{ static_cast<uint32_t*>(pSurface->pixels) }
+	Texture::Texture(std::vector<uint32_t> texels, int width, int height)
 	{
+		// Images that aren't a power of two are stretched to the next one
+		const int powerOfTwoWidth{ static_cast<int>(std::bit_ceil(static_cast<uint32_t>(width))) };
+		const int powerOfTwoHeight{ static_cast<int>(std::bit_ceil(static_cast<uint32_t>(height))) };
+		if (powerOfTwoWidth != width or powerOfTwoHeight != height)
+		{
+			texels = ResizeTexels(texels, width, height, powerOfTwoWidth, powerOfTwoHeight);
+			width = powerOfTwoWidth;
+			height = powerOfTwoHeight;
+		}
+
+		AddMipLevel(width, height, texels);
+
+		// Every texel of the next level is the average of the four it covers
+		while (width > 1 or height > 1)
+		{
+			const int levelWidth{ std::max(width / 2, 1) };
+			const int levelHeight{ std::max(height / 2, 1) };
+			std::vector<uint32_t> levelTexels(static_cast<size_t>(levelWidth) * levelHeight);
+
+			for (int y{}; y < levelHeight; y++)
+			{
+				const int sourceY0{ std::min(y * 2, height - 1) };
+				const int sourceY1{ std::min(y * 2 + 1, height - 1) };
+
+				for (int x{}; x < levelWidth; x++)
+				{
+					const int sourceX0{ std::min(x * 2, width - 1) };
+					const int sourceX1{ std::min(x * 2 + 1, width - 1) };
+
+					const uint32_t sourceTexels[4]
+					{
+						texels[sourceX0 + sourceY0 * width],
+						texels[sourceX1 + sourceY0 * width],
+						texels[sourceX0 + sourceY1 * width],
+						texels[sourceX1 + sourceY1 * width]
+					};
+
+					uint32_t average{};
+					for (int shift{}; shift < 32; shift += 8)
+					{
+						uint32_t sum{ 2 };
+						for (uint32_t texel : sourceTexels)
+							sum += texel >> shift & 0xFF;
+
+						average |= sum / 4 << shift;
+					}
+
+					levelTexels[x + y * levelWidth] = average;
+				}
+			}
+
+			width = levelWidth;
+			height = levelHeight;
+			texels = std::move(levelTexels);
+			AddMipLevel(width, height, texels);
+		}
+	}
+
+	Texture* Texture::LoadFromFile(const std::string& fileName)
+	{
+		int width{};
+		int height{};
+		std::vector<uint32_t> texels{};
+
+		if (!LoadTexels(fileName, texels, width, height))
+			return nullptr;
+
+		return new Texture(std::move(texels), width, height);
 	}
 
-	Texture::~Texture()
+	Texture* Texture::LoadPacked(const std::string& redFileName, const std::string& greenFileName, const std::string& blueFileName)
 	{
-		if (m_SurfacePtr)
+		const std::string fileNames[3]{ redFileName, greenFileName, blueFileName };
+
+		int width{};
+		int height{};
+		std::vector<uint32_t> channelTexels[3]{};
+		bool hasChannel[3]{};
+
+		for (int channel{}; channel < 3; channel++)
 		{
-			SDL_FreeSurface(m_SurfacePtr);
-			m_SurfacePtr = nullptr;
+			if (fileNames[channel].empty())
+				continue;
+
+			int channelWidth{};
+			int channelHeight{};
+			hasChannel[channel] = LoadTexels(fileNames[channel], channelTexels[channel], channelWidth, channelHeight);
+
+			if (!hasChannel[channel])
+				continue;
+
+			// Maps of different sizes are stretched to the largest one
+			if (width == 0)
+			{
+				width = channelWidth;
+				height = channelHeight;
+			}
+			else if (channelWidth != width or channelHeight != height)
+			{
+				const int newWidth{ std::max(width, channelWidth) };
+				const int newHeight{ std::max(height, channelHeight) };
+
+				for (int resizedChannel{}; resizedChannel <= channel; resizedChannel++)
+				{
+					if (!hasChannel[resizedChannel])
+						continue;
+
+					const bool isCurrentChannel{ resizedChannel == channel };
+					channelTexels[resizedChannel] = ResizeTexels(channelTexels[resizedChannel],
+						isCurrentChannel ? channelWidth : width, isCurrentChannel ? channelHeight : height, newWidth, newHeight);
+				}
+
+				width = newWidth;
+				height = newHeight;
+			}
 		}
+
+		if (width == 0)
+			return nullptr;
+
+		// Only the red channel of every map is used, missing maps are white and alpha is opaque
+		std::vector<uint32_t> texels(static_cast<size_t>(width) * height);
+		for (size_t texelIndex{}; texelIndex < texels.size(); texelIndex++)
+		{
+			uint32_t texel{ 0xFF000000 };
+			for (int channel{}; channel < 3; channel++)
+			{
+				const uint32_t value{ hasChannel[channel] ? channelTexels[channel][texelIndex] & 0xFF : 0xFF };
+				texel |= value << channel * 8;
+			}
+
+			texels[texelIndex] = texel;
+		}
+
+		return new Texture(std::move(texels), width, height);
 	}
 
-	Texture* Texture::LoadFromFile(const std::string& fileName)
+	bool Texture::LoadTexels(const std::string& fileName, std::vector<uint32_t>& texels, int& width, int& height)
 	{
 		const std::string path{ std::format("{}{}",RESOURCES_PATH,fileName) };
 
@@ -35,7 +162,7 @@ namespace dae
 		if (loadedSurfacePtr == nullptr)
 		{
 			std::cout << "Texture Can't be loaded: " << path.c_str() << std::endl;
-			return nullptr;
+			return false;
 		}
 
 		//if (loadedSurfacePtr->format->BitsPerPixel != 8)
@@ -44,101 +171,183 @@ namespace dae
 		//	return nullptr;
 		//}
 
-		// Create and return a new Texture Object (using SDL_Surface)
-		return new Texture(loadedSurfacePtr);
+		// Surfaces can come in any format, texels are unpacked once so sampling doesn't need it
+		SDL_Surface* pConvertedSurface{ SDL_ConvertSurfaceFormat(loadedSurfacePtr, SDL_PIXELFORMAT_RGBA32, 0) };
+		SDL_FreeSurface(loadedSurfacePtr);
+
+		if (pConvertedSurface == nullptr)
+		{
+			std::cout << "Texture Can't be converted: " << path.c_str() << " " << SDL_GetError() << std::endl;
+			return false;
+		}
+
+		width = pConvertedSurface->w;
+		height = pConvertedSurface->h;
+		texels.resize(static_cast<size_t>(width) * height);
+
+		for (int y{}; y < height; y++)
+		{
+			const uint32_t* pRow{ reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(pConvertedSurface->pixels) + y * pConvertedSurface->pitch) };
+
+			for (int x{}; x < width; x++)
+			{
+				Uint8 red{};
+				Uint8 green{};
+				Uint8 blue{};
+				Uint8 alpha{};
+				SDL_GetRGBA(pRow[x], pConvertedSurface->format, &red, &green, &blue, &alpha);
+
+				texels[x + y * width] = red | green << 8 | blue << 16 | static_cast<uint32_t>(alpha) << 24;
+			}
+		}
+
+		SDL_FreeSurface(pConvertedSurface);
+		return true;
 	}
 
-	ColorRGB Texture::Sample(const Vector2& uv) const
+	ColorRGB Texture::Sample(const Vector2& uv, const Vector2& uvDerivativeX, const Vector2& uvDerivativeY) const
 	{
-		float u{ uv.x };
-		float v{ uv.y };
+		// Wrapping happens per texel in SampleLevel
+		const float u{ uv.x };
+		const float v{ uv.y };
 
-		// Handle uv wrapping
-		if constexpr (true)
-		{
-			while (u > 1.0f)
-				u -= 1.0f;
+		// Texels covered by one pixel on screen, along the axis where it covers the most
+		const float baseWidth{ static_cast<float>(m_MipLevels[0].width) };
+		const float baseHeight{ static_cast<float>(m_MipLevels[0].height) };
+		const Vector2 texelsX{ uvDerivativeX.x * baseWidth, uvDerivativeX.y * baseHeight };
+		const Vector2 texelsY{ uvDerivativeY.x * baseWidth, uvDerivativeY.y * baseHeight };
+		const float footprint{ std::max(texelsX.SqrMagnitude(), texelsY.SqrMagnitude()) };
 
-			while (u < 0.0f)
-				u += 1.0f;
+		// Half of the log, as the footprint is squared
+		const float levelOfDetail{ 0.5f * std::log2(footprint) };
 
-			while (v > 1.0f)
-				v -= 1.0f;
+		// Magnified, also catches derivatives that aren't numbers
+		if (!(levelOfDetail > 0.0f))
+			return SampleLevel(m_MipLevels[0], u, v);
 
-			while (v < 0.0f)
-				v += 1.0f;
-		}
-		else
-		{
-			u = std::fmodf(u, 1.0f);
-			v = std::fmodf(v, 1.0f);
+		const int lastLevel{ static_cast<int>(m_MipLevels.size()) - 1 };
+		if (levelOfDetail >= static_cast<float>(lastLevel))
+			return SampleLevel(m_MipLevels[lastLevel], u, v);
 
-			// Ensure the result is positive
-			u = (u < 0.0f) ? (u + 1.0f) : u;
-			v = (v < 0.0f) ? (v + 1.0f) : v;
-		}
+		// Trilinear, blend between the two nearest levels
+		const int lowerLevel{ static_cast<int>(levelOfDetail) };
+		return ColorRGB::Lerp(
+			SampleLevel(m_MipLevels[lowerLevel], u, v),
+			SampleLevel(m_MipLevels[lowerLevel + 1], u, v),
+			levelOfDetail - static_cast<float>(lowerLevel));
+	}
 
-		constexpr bool useBilinearInterpolation = true;
+	std::vector<uint32_t> Texture::ResizeTexels(const std::vector<uint32_t>& texels, int width, int height, int newWidth, int newHeight)
+	{
+		std::vector<uint32_t> resizedTexels(static_cast<size_t>(newWidth) * newHeight);
 
-		if (useBilinearInterpolation)
+		// Bilinear, texel centers line up with the centers of the original image
+		for (int y{}; y < newHeight; y++)
 		{
-			// Convert UV coordinates to texel coordinates
-			const float texelXf = u * static_cast<float>(m_SurfacePtr->w - 1);
-			const float texelYf = v * static_cast<float>(m_SurfacePtr->h - 1);
-
-			// Get the integer part and fractional part of texel coordinates
-			const int texelX = static_cast<int>(texelXf);
-			const int texelY = static_cast<int>(texelYf);
-			const float fracX = texelXf - texelX;
-			const float fracY = texelYf - texelY;
-
-			// Sample colors from four neighboring texels
-			const ColorRGB c00 = GetTexelColor(texelX, texelY);
-			const ColorRGB c10 = GetTexelColor(texelX + 1, texelY);
-			const ColorRGB c01 = GetTexelColor(texelX, texelY + 1);
-			const ColorRGB c11 = GetTexelColor(texelX + 1, texelY + 1);
-
-			// Bilinear interpolation
-			const ColorRGB interpolatedColor =
-				Lerp(
-					Lerp(c00, c10, fracX),
-					Lerp(c01, c11, fracX),
-					fracY
-				);
-
-			return interpolatedColor;
+			const float sourceY{ std::clamp((static_cast<float>(y) + 0.5f) * static_cast<float>(height) / static_cast<float>(newHeight) - 0.5f, 0.0f, static_cast<float>(height - 1)) };
+			const int sourceY0{ static_cast<int>(sourceY) };
+			const int sourceY1{ std::min(sourceY0 + 1, height - 1) };
+			const float fractionY{ sourceY - static_cast<float>(sourceY0) };
+
+			for (int x{}; x < newWidth; x++)
+			{
+				const float sourceX{ std::clamp((static_cast<float>(x) + 0.5f) * static_cast<float>(width) / static_cast<float>(newWidth) - 0.5f, 0.0f, static_cast<float>(width - 1)) };
+				const int sourceX0{ static_cast<int>(sourceX) };
+				const int sourceX1{ std::min(sourceX0 + 1, width - 1) };
+				const float fractionX{ sourceX - static_cast<float>(sourceX0) };
+
+				uint32_t resizedTexel{};
+				for (int shift{}; shift < 32; shift += 8)
+				{
+					const auto channel = [&](int sourceX, int sourceY) { return static_cast<float>(texels[sourceX + sourceY * width] >> shift & 0xFF); };
+
+					const float value{ Lerpf(
+						Lerpf(channel(sourceX0, sourceY0), channel(sourceX1, sourceY0), fractionX),
+						Lerpf(channel(sourceX0, sourceY1), channel(sourceX1, sourceY1), fractionX),
+						fractionY) };
+
+					resizedTexel |= static_cast<uint32_t>(value + 0.5f) << shift;
+				}
+
+				resizedTexels[x + y * newWidth] = resizedTexel;
+			}
 		}
-		else
+
+		return resizedTexels;
+	}
+
+	void Texture::AddMipLevel(int width, int height, const std::vector<uint32_t>& texels)
+	{
+		MipLevel& level{ m_MipLevels.emplace_back() };
+		level.width = width;
+		level.height = height;
+
+		// Levels smaller than a tile still take up a whole tile
+		level.tileCountX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		const int tileCountY{ (height + TILE_SIZE - 1) / TILE_SIZE };
+		level.texels.resize(static_cast<size_t>(level.tileCountX) * tileCountY * TILE_SIZE * TILE_SIZE);
+
+		for (int y{}; y < height; y++)
 		{
-			// Convert UV coordinates to texel coordinates
-			const float texelXf = u * static_cast<float>(m_SurfacePtr->w - 1);
-			const float texelYf = v * static_cast<float>(m_SurfacePtr->h - 1);
-
-			// Get the integer part and fractional part of texel coordinates
-			const int texelX = static_cast<int>(texelXf);
-			const int texelY = static_cast<int>(texelYf);
-			return GetTexelColor(texelX, texelY);
+			for (int x{}; x < width; x++)
+				level.texels[GetTexelIndex(level, x, y)] = texels[x + y * width];
 		}
 	}
 
-
-	ColorRGB Texture::GetTexelColor(int x, int y) const
+	ColorRGB Texture::SampleLevel(const MipLevel& level, float u, float v) const
 	{
-		// Get the pixel value at the texel coordinates
-		const uint32_t pixel = m_SurfacePixelsPtr[y * m_SurfacePtr->w + x];
+		// Texel centers are at half texels, positions are rounded to fixed point for both axes at once
+		constexpr float subtexelSteps{ 1 << SUBTEXEL_BITS };
+		const __m128 position{ _mm_sub_ps(
+			_mm_mul_ps(_mm_setr_ps(u, v, 0.0f, 0.0f), _mm_setr_ps(static_cast<float>(level.width) * subtexelSteps, static_cast<float>(level.height) * subtexelSteps, 0.0f, 0.0f)),
+			_mm_set1_ps(subtexelSteps * 0.5f)) };
 
-		Uint8 red{};
-		Uint8 green{};
-		Uint8 blue{};
+		alignas(16) int32_t fixedPosition[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(fixedPosition), _mm_cvtps_epi32(position));
 
-		SDL_GetRGB(pixel, m_SurfacePtr->format, &red, &green, &blue);
+		// Sizes are powers of two, so wrapping is a mask, this also keeps positions outside of the int range in the texture
+		constexpr int subtexelMask{ (1 << SUBTEXEL_BITS) - 1 };
+		const int texelX0{ (fixedPosition[0] >> SUBTEXEL_BITS) & (level.width - 1) };
+		const int texelY0{ (fixedPosition[1] >> SUBTEXEL_BITS) & (level.height - 1) };
+		const int texelX1{ (texelX0 + 1) & (level.width - 1) };
+		const int texelY1{ (texelY0 + 1) & (level.height - 1) };
+		const int16_t fractionX{ static_cast<int16_t>(fixedPosition[0] & subtexelMask) };
+		const int16_t fractionY{ static_cast<int16_t>(fixedPosition[1] & subtexelMask) };
 
-		// Return the sampled color
-		return
-		{
-			static_cast<float>(red) / 255.0f,
-			static_cast<float>(green) / 255.0f,
-			static_cast<float>(blue) / 255.0f,
-		};
+		// The four taps are gathered with their channels widened to 16 bits, the top row in the low half
+		const __m128i zero{ _mm_setzero_si128() };
+		const __m128i left{ _mm_unpacklo_epi8(_mm_setr_epi32(
+			static_cast<int>(level.texels[GetTexelIndex(level, texelX0, texelY0)]),
+			static_cast<int>(level.texels[GetTexelIndex(level, texelX0, texelY1)]), 0, 0), zero) };
+		const __m128i right{ _mm_unpacklo_epi8(_mm_setr_epi32(
+			static_cast<int>(level.texels[GetTexelIndex(level, texelX1, texelY0)]),
+			static_cast<int>(level.texels[GetTexelIndex(level, texelX1, texelY1)]), 0, 0), zero) };
+
+		// Horizontal blend of both rows fits in 16 bits
+		constexpr int16_t subtexelSteps16{ 1 << SUBTEXEL_BITS };
+		const __m128i rows{ _mm_add_epi16(
+			_mm_mullo_epi16(left, _mm_set1_epi16(static_cast<int16_t>(subtexelSteps16 - fractionX))),
+			_mm_mullo_epi16(right, _mm_set1_epi16(fractionX))) };
+
+		// Vertical blend pairs every channel of the top row with the bottom row, the sum goes to 32 bits
+		const __m128i rowPairs{ _mm_unpacklo_epi16(rows, _mm_srli_si128(rows, 8)) };
+		const __m128i channels{ _mm_madd_epi16(rowPairs, _mm_set1_epi32(static_cast<int>(static_cast<uint16_t>(subtexelSteps16 - fractionY)) | fractionY << 16)) };
+
+		alignas(16) float color[4];
+		constexpr float toFloat{ 1.0f / (255.0f * (1 << SUBTEXEL_BITS * 2)) };
+		_mm_store_ps(color, _mm_mul_ps(_mm_cvtepi32_ps(channels), _mm_set1_ps(toFloat)));
+
+		return { color[0], color[1], color[2] };
+	}
+
+	uint32_t Texture::GetTexelIndex(const MipLevel& level, int x, int y)
+	{
+		// Spreads the three bits of a coordinate within a tile to every other bit
+		constexpr uint32_t spreadBits[TILE_SIZE]{ 0b000000, 0b000001, 0b000100, 0b000101, 0b010000, 0b010001, 0b010100, 0b010101 };
+
+		constexpr int tileMask{ TILE_SIZE - 1 };
+		const uint32_t tileIndex{ static_cast<uint32_t>((y >> TILE_SIZE_BITS) * level.tileCountX + (x >> TILE_SIZE_BITS)) };
+
+		return tileIndex << TILE_SIZE_BITS * 2 | spreadBits[y & tileMask] << 1 | spreadBits[x & tileMask];
 	}
 }
\ No newline at end of file
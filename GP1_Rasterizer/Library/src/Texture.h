@@ -1,26 +1,51 @@
 #pragma once
 #include <SDL_surface.h>
 #include <string>
+#include <vector>
 #include "ColorRGB.h"
+#include "Vector2.h"
 
 namespace dae
 {
-	struct Vector2;
-
 	class Texture
 	{
 	public:
-		~Texture();
+		~Texture() = default;
 
 		static Texture* LoadFromFile(const std::string& fileName);
-		ColorRGB Sample(const Vector2& uv) const;
+
+		// Combines the first channel of up to three grayscale maps into one texture, so they are fetched together
+		// Empty names or maps that fail to load become white, returns nullptr when none of them load
+		static Texture* LoadPacked(const std::string& redFileName, const std::string& greenFileName, const std::string& blueFileName);
+
+		// The derivatives are how much the uv changes per pixel on screen, they pick the mip level
+		// Without them the full resolution is sampled
+		ColorRGB Sample(const Vector2& uv, const Vector2& uvDerivativeX = {}, const Vector2& uvDerivativeY = {}) const;
 
 	private:
-		Texture(SDL_Surface* pSurface);
+		// Texels hold red, green, blue and alpha bytes, starting from the lowest byte
+		// They are stored in square tiles, and in Morton order within a tile, so texels that are close stay in the same cache lines
+		struct MipLevel
+		{
+			int width;	// Always a power of two, so coordinates wrap with a mask
+			int height;
+			int tileCountX;
+			std::vector<uint32_t> texels;
+		};
+
+		static constexpr int TILE_SIZE_BITS{ 3 };
+		static constexpr int TILE_SIZE{ 1 << TILE_SIZE_BITS };
+		static constexpr int SUBTEXEL_BITS{ 7 };	// Bilinear weights are fixed point, small enough to be blended in 16 bits
+
+		Texture(std::vector<uint32_t> texels, int width, int height);
 
-		ColorRGB GetTexelColor(int x, int y) const;
+		static bool LoadTexels(const std::string& fileName, std::vector<uint32_t>& texels, int& width, int& height);
+		static std::vector<uint32_t> ResizeTexels(const std::vector<uint32_t>& texels, int width, int height, int newWidth, int newHeight);
+		void AddMipLevel(int width, int height, const std::vector<uint32_t>& texels);
+		ColorRGB SampleLevel(const MipLevel& level, float u, float v) const;
+		static uint32_t GetTexelIndex(const MipLevel& level, int x, int y);
 
-		SDL_Surface* m_SurfacePtr{ nullptr };
-		uint32_t* m_SurfacePixelsPtr{ nullptr };
+		// Level 0 is the loaded image, every next level is half the size down to a single texel
+		std::vector<MipLevel> m_MipLevels{};
 	};
-}
\ No newline at end of file
+}
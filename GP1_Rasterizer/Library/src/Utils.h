@@ -363,6 +363,15 @@ namespace dae
 			std::string command;
 			std::string currentMaterialName;
 
+			// Scalar maps are only loaded once every one of them is known, so they can be packed together
+			struct SurfaceMaps
+			{
+				std::string specular;
+				std::string gloss;
+				std::string opacity;
+			};
+			std::map<std::string, SurfaceMaps> surfaceMaps{};
+
 			// start a while iteration ending when the end of file is reached (ios::eof)
 			while (!file.eof())
 			{
@@ -402,7 +411,23 @@ namespace dae
 					file >> texturePath;
 
 					std::cout << "Set d: " << texturePath << std::endl;
-					materials[currentMaterialName]->opacity = Texture::LoadFromFile(texturePath);
+					surfaceMaps[currentMaterialName].opacity = texturePath;
+				}
+				else if (command == "map_Ks")
+				{
+					std::string texturePath;
+					file >> texturePath;
+
+					std::cout << "Set Ks: " << texturePath << std::endl;
+					surfaceMaps[currentMaterialName].specular = texturePath;
+				}
+				else if (command == "map_Ns")
+				{
+					std::string texturePath;
+					file >> texturePath;
+
+					std::cout << "Set Ns: " << texturePath << std::endl;
+					surfaceMaps[currentMaterialName].gloss = texturePath;
 				}
 
 	
@@ -410,6 +435,13 @@ namespace dae
 				file.ignore(1000, '\n');
 			}
 
+			for (const auto& [name, maps] : surfaceMaps)
+			{
+				Material* material{ materials[name] };
+				material->surface = Texture::LoadPacked(maps.specular, maps.gloss, maps.opacity);
+				material->hasOpacity = material->surface != nullptr and !maps.opacity.empty();
+			}
+
 
 			std::cout << std::endl;
 			return true;
@@ -1,5 +1,9 @@
 #include "Light.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 namespace dae
 {
 	Light::Light(const Vector3& origin, const Vector3& direction, const ColorRGB& color, const float intensity, const LightType type) :
@@ -22,4 +26,16 @@ namespace dae
 		return {0,0,0};
 	}
 
+	float Light::GetRange(float minRadiance) const
+	{
+		if (m_Type == LightType::Point)
+		{
+			// Inverse of GetRadiance
+			const float brightestChannel{ std::max(m_Color.r, std::max(m_Color.g, m_Color.b)) };
+			return std::sqrt(brightestChannel * m_Intensity / minRadiance);
+		}
+
+		return std::numeric_limits<float>::infinity();
+	}
+
 }
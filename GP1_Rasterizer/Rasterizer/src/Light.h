@@ -17,6 +17,9 @@ namespace dae
 		Light(const Vector3& origin,const Vector3& direction,const ColorRGB& color,float intensity, LightType type);
 
 		ColorRGB GetRadiance(const Vector3& target) const;
+
+		// Distance where the radiance of the brightest channel drops to minRadiance, directional lights reach everywhere
+		float GetRange(float minRadiance) const;
 		const Vector3& GetOrigin() const { return m_Origin; }
 		const Vector3& GetDirection() const { return m_Direction; }
 
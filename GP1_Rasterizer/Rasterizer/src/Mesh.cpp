@@ -1,6 +1,7 @@
 #include "Mesh.h"
 
-#include <cassert>
+#include <algorithm>
+#include <numeric>
 
 #include "Utils.h"
 
@@ -9,8 +10,6 @@ namespace dae
 {
 	Mesh::Mesh(std::vector<VertexModel> vertices, std::vector<uint32_t> indices,
 		std::vector<Material*> materials, PrimitiveTopology primitiveTopology) :
-		m_VerticesModel(std::move(vertices)),
-		m_VerticesTransformed(m_VerticesModel.size(), std::make_shared<VertexTransformed>()),
 		m_Indices(std::move(indices)),
 		m_MaterialPtrs(std::move(materials)),
 		m_PrimitiveTopology(primitiveTopology),
@@ -18,9 +17,9 @@ namespace dae
 		m_Scale(1.0f, 1.0f, 1.0f),
 		m_Position(0.0f, 0.0f, 0.0f)
 	{
-		InitializeVertices();
-		InitializeVertexColors();
-		InitializeTriangles();
+		InitializeTriangles(vertices);
+		InitializeClusters(vertices);
+		InitializeVertices(vertices);
 	}
 
 	Mesh::Mesh(const std::string& objName, std::vector<Material*> materials, PrimitiveTopology primitiveTopology) :
@@ -30,11 +29,13 @@ namespace dae
 		m_Scale(1.0f, 1.0f, 1.0f),
 		m_Position(0.0f, 0.0f, 0.0f)
 	{
-		Utils::ParseOBJ(objName, m_VerticesModel, m_Indices);
+		// Parsed vertices are only kept until they are split in their components
+		std::vector<VertexModel> vertices{};
+		Utils::ParseOBJ(objName, vertices, m_Indices);
 
-		InitializeVertices();
-		InitializeVertexColors();
-		InitializeTriangles();
+		InitializeTriangles(vertices);
+		InitializeClusters(vertices);
+		InitializeVertices(vertices);
 	}
 
 	Mesh::Mesh(const std::string& objName, const std::string& mtlName, std::map<std::string, Material*>& materialMap, PrimitiveTopology primitiveTopology) :
@@ -53,8 +54,9 @@ namespace dae
 		materialMap.insert(parsedMaterials.begin(), parsedMaterials.end());
 
 		// Parse OBJ
+		std::vector<VertexModel> vertices{};
 		std::vector<std::string> mappedMaterials{};
-		Utils::ParseOBJ(objName, m_VerticesModel, m_Indices, mappedMaterials);
+		Utils::ParseOBJ(objName, vertices, m_Indices, mappedMaterials);
 
 		// Insert material pointers based on the index given from mappedMaterials
 		m_MaterialPtrs.resize(mappedMaterials.size());
@@ -66,9 +68,9 @@ namespace dae
 		}
 		
 
-		InitializeVertices();
-		InitializeVertexColors();
-		InitializeTriangles();
+		InitializeTriangles(vertices);
+		InitializeClusters(vertices);
+		InitializeVertices(vertices);
 	}
 
 
@@ -97,81 +99,259 @@ namespace dae
 	}
 
 
-	void Mesh::InitializeVertices()
+	ColorRGB Mesh::GetVertexColor(uint32_t vertexIndex)
 	{
-		m_VerticesTransformed.resize(m_VerticesModel.size());
-		for (size_t i = 0; i < m_VerticesModel.size(); i++)
+		switch (vertexIndex % 3)
 		{
-			m_VerticesTransformed[i] = std::make_shared<VertexTransformed>();
+		case 0: return colors::Red;
+		case 1: return colors::Green;
+		default: return colors::Blue;
+		}
+	}
+
+
+	void Mesh::InitializeVertices(const std::vector<VertexModel>& vertices)
+	{
+		m_Vertices.Resize(vertices.size());
+		m_VerticesTransformed.Resize(vertices.size());
 
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
 			// Force the normal and tangent to be normalized
 			// This is to avoid user error
-			m_VerticesModel[i].normal = m_VerticesModel[i].normal.Normalized();
-			m_VerticesModel[i].tangent = m_VerticesModel[i].tangent.Normalized();
+			const Vector3 normal{ vertices[i].normal.Normalized() };
+			const Vector3 tangent{ vertices[i].tangent.Normalized() };
+
+			m_Vertices.positionX[i] = vertices[i].pos.x;
+			m_Vertices.positionY[i] = vertices[i].pos.y;
+			m_Vertices.positionZ[i] = vertices[i].pos.z;
+			m_Vertices.normalX[i] = normal.x;
+			m_Vertices.normalY[i] = normal.y;
+			m_Vertices.normalZ[i] = normal.z;
+			m_Vertices.tangentX[i] = tangent.x;
+			m_Vertices.tangentY[i] = tangent.y;
+			m_Vertices.tangentZ[i] = tangent.z;
+			m_Vertices.uv[i] = vertices[i].uv;
 		}
-
 	}
 
-	void Mesh::InitializeVertexColors()
+	void Mesh::InitializeTriangles(const std::vector<VertexModel>& vertices)
 	{
-		// Color world vertex
-		int vertexIndex{ 0 };
-		for (VertexModel& vertex : m_VerticesModel)
+		// Strips are turned into lists, so every triangle is three indices from then on
+		if (m_PrimitiveTopology == PrimitiveTopology::TriangleStrip)
 		{
-			if (vertexIndex == 0)
-				vertex.color = colors::Red;
+			std::vector<uint32_t> listIndices{};
 
-			if (vertexIndex == 1)
-				vertex.color = colors::Green;
+			for (int triangleIndex{}; triangleIndex < static_cast<int>(m_Indices.size() - 2); triangleIndex++)
+			{
+				listIndices.push_back(m_Indices[triangleIndex]);
 
-			if (vertexIndex == 2)
-				vertex.color = colors::Blue;
+				if (triangleIndex % 2 == 0)
+				{
+					listIndices.push_back(m_Indices[triangleIndex + 1]);
+					listIndices.push_back(m_Indices[triangleIndex + 2]);
+				}
+				else
+				{
+					listIndices.push_back(m_Indices[triangleIndex + 2]);
+					listIndices.push_back(m_Indices[triangleIndex + 1]);
+				}
+			}
 
-			vertexIndex++;
-			vertexIndex %= 3;
+			m_Indices = std::move(listIndices);
 		}
+
+		// The first vertex decides the material of the triangle
+		m_TriangleMaterialIndices.resize(GetTriangleCount());
+		for (uint32_t triangleIndex{}; triangleIndex < GetTriangleCount(); triangleIndex++)
+			m_TriangleMaterialIndices[triangleIndex] = vertices[m_Indices[triangleIndex * 3]].materialIndex;
 	}
 
-	void Mesh::InitializeTriangles()
+	void Mesh::InitializeClusters(std::vector<VertexModel>& vertices)
 	{
-		m_Triangles.clear();
+		const uint32_t triangleCount{ GetTriangleCount() };
 
-		if (m_PrimitiveTopology == PrimitiveTopology::TriangleList)
+		// Triangles are grouped by material and by the axis their face normal points along the most
+		// That keeps the normals of a cluster within 55 degrees of the axis, so its cone can be culled
+		std::vector<Vector3> centers(triangleCount);
+		std::vector<int> groups(triangleCount);
+		for (uint32_t triangleIndex{}; triangleIndex < triangleCount; triangleIndex++)
 		{
-			for (int triangleIndex{}; triangleIndex < static_cast<int>(m_Indices.size()); triangleIndex += 3)
+			const Vector3& position0{ vertices[m_Indices[triangleIndex * 3]].pos };
+			const Vector3& position1{ vertices[m_Indices[triangleIndex * 3 + 1]].pos };
+			const Vector3& position2{ vertices[m_Indices[triangleIndex * 3 + 2]].pos };
+			centers[triangleIndex] = (position0 + position1 + position2) / 3.0f;
+
+			const Vector3 faceNormal{ Vector3::Cross(position1 - position0, position2 - position0) };
+			const Vector3 absoluteNormal{ std::abs(faceNormal.x), std::abs(faceNormal.y), std::abs(faceNormal.z) };
+			const int axis{ absoluteNormal.x >= absoluteNormal.y and absoluteNormal.x >= absoluteNormal.z ? 0 : absoluteNormal.y >= absoluteNormal.z ? 1 : 2 };
+			const int direction{ faceNormal[axis] < 0.0f ? 1 : 0 };
+
+			groups[triangleIndex] = m_TriangleMaterialIndices[triangleIndex] * 6 + axis * 2 + direction;
+		}
+
+		// Positions in the sorted triangles below
+		struct TriangleRange
+		{
+			uint32_t start;
+			uint32_t end;
+		};
+
+		// Every group becomes at least one cluster
+		std::vector<uint32_t> triangles(triangleCount);
+		std::iota(triangles.begin(), triangles.end(), 0);
+		std::ranges::stable_sort(triangles, {}, [&groups](uint32_t triangleIndex) { return groups[triangleIndex]; });
+
+		std::vector<TriangleRange> pendingRanges{};
+		for (uint32_t rangeStart{}; rangeStart < triangleCount;)
+		{
+			uint32_t rangeEnd{ rangeStart + 1 };
+			while (rangeEnd < triangleCount and groups[triangles[rangeEnd]] == groups[triangles[rangeStart]])
+				rangeEnd++;
+
+			pendingRanges.push_back({ rangeStart, rangeEnd });
+			rangeStart = rangeEnd;
+		}
+
+		// Ranges that are too large are split in half along the longest axis of their triangle centers
+		std::vector<TriangleRange> clusterRanges{};
+		while (!pendingRanges.empty())
+		{
+			const TriangleRange range{ pendingRanges.back() };
+			pendingRanges.pop_back();
+
+			if (range.end - range.start <= MAX_CLUSTER_TRIANGLES)
 			{
-				m_Triangles.push_back(
+				clusterRanges.push_back(range);
+				continue;
+			}
+
+			Vector3 centerMin{ centers[triangles[range.start]] };
+			Vector3 centerMax{ centerMin };
+			for (uint32_t i{ range.start }; i < range.end; i++)
+			{
+				const Vector3& center{ centers[triangles[i]] };
+				for (int axis{}; axis < 3; axis++)
 				{
-					m_VerticesTransformed[m_Indices[triangleIndex]],
-					m_VerticesTransformed[m_Indices[triangleIndex + 1]],
-					m_VerticesTransformed[m_Indices[triangleIndex + 2]],
-				});
+					centerMin[axis] = std::min(centerMin[axis], center[axis]);
+					centerMax[axis] = std::max(centerMax[axis], center[axis]);
+				}
 			}
+
+			const Vector3 extent{ centerMax - centerMin };
+			const int axis{ extent.x >= extent.y and extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2 };
+
+			const uint32_t middle{ range.start + (range.end - range.start) / 2 };
+			std::nth_element(triangles.begin() + range.start, triangles.begin() + middle, triangles.begin() + range.end,
+				[&](uint32_t triangle1, uint32_t triangle2) { return centers[triangle1][axis] < centers[triangle2][axis]; });
+
+			// Second half first, so clusters come out in the order of the ranges
+			pendingRanges.push_back({ middle, range.end });
+			pendingRanges.push_back({ range.start, middle });
 		}
-		else
+
+		// Every cluster gets its own copy of the vertices it uses
+		std::vector<VertexModel> clusteredVertices{};
+		std::vector<uint32_t> clusteredIndices{};
+		std::vector<int> clusteredMaterialIndices{};
+		std::vector<uint32_t> vertexClusters(vertices.size(), UINT32_MAX);
+		std::vector<uint32_t> vertexRemap(vertices.size());
+
+		m_Clusters.clear();
+		for (const TriangleRange& range : clusterRanges)
 		{
-			for (int triangleIndex{}; triangleIndex < static_cast<int>(m_Indices.size() - 2); triangleIndex++)
+			const uint32_t clusterIndex{ static_cast<uint32_t>(m_Clusters.size()) };
+
+			MeshCluster cluster{};
+			cluster.triangleStart = static_cast<uint32_t>(clusteredMaterialIndices.size());
+			cluster.triangleCount = range.end - range.start;
+			cluster.vertexStart = static_cast<uint32_t>(clusteredVertices.size());
+			cluster.boundsMin = vertices[m_Indices[triangles[range.start] * 3]].pos;
+			cluster.boundsMax = cluster.boundsMin;
+
+			for (uint32_t i{ range.start }; i < range.end; i++)
 			{
-				if (triangleIndex % 2 == 0)
-				{
-					m_Triangles.push_back(
-					{
-						m_VerticesTransformed[m_Indices[triangleIndex]],
-						m_VerticesTransformed[m_Indices[triangleIndex + 1]],
-						m_VerticesTransformed[m_Indices[triangleIndex + 2]]
-					});
-				}
-				else
+				const uint32_t triangleIndex{ triangles[i] };
+
+				for (int corner{}; corner < 3; corner++)
 				{
-					m_Triangles.push_back(
+					const uint32_t vertexIndex{ m_Indices[triangleIndex * 3 + corner] };
+
+					if (vertexClusters[vertexIndex] != clusterIndex)
 					{
-						m_VerticesTransformed[m_Indices[triangleIndex]],
-						m_VerticesTransformed[m_Indices[triangleIndex + 2]],
-						m_VerticesTransformed[m_Indices[triangleIndex + 1]]
-					});
+						vertexClusters[vertexIndex] = clusterIndex;
+						vertexRemap[vertexIndex] = static_cast<uint32_t>(clusteredVertices.size());
+						clusteredVertices.push_back(vertices[vertexIndex]);
+
+						const Vector3& position{ vertices[vertexIndex].pos };
+						for (int axis{}; axis < 3; axis++)
+						{
+							cluster.boundsMin[axis] = std::min(cluster.boundsMin[axis], position[axis]);
+							cluster.boundsMax[axis] = std::max(cluster.boundsMax[axis], position[axis]);
+						}
+					}
+
+					clusteredIndices.push_back(vertexRemap[vertexIndex]);
 				}
+
+				clusteredMaterialIndices.push_back(m_TriangleMaterialIndices[triangleIndex]);
 			}
+
+			clusteredVertices.resize(GetPaddedVertexCount(clusteredVertices.size()));
+			cluster.vertexCount = static_cast<uint32_t>(clusteredVertices.size()) - cluster.vertexStart;
+			InitializeClusterCone(cluster, clusteredVertices, clusteredIndices);
+			m_Clusters.push_back(cluster);
 		}
+
+		vertices = std::move(clusteredVertices);
+		m_Indices = std::move(clusteredIndices);
+		m_TriangleMaterialIndices = std::move(clusteredMaterialIndices);
+	}
+
+	void Mesh::InitializeClusterCone(MeshCluster& cluster, const std::vector<VertexModel>& vertices, const std::vector<uint32_t>& indices) const
+	{
+		// Padding vertices are not used by any triangle, so they are left out of the sphere
+		cluster.sphereCenter = (cluster.boundsMin + cluster.boundsMax) * 0.5f;
+		cluster.sphereRadius = 0.0f;
+
+		const uint32_t firstIndex{ cluster.triangleStart * 3 };
+		const uint32_t lastIndex{ (cluster.triangleStart + cluster.triangleCount) * 3 };
+
+		for (uint32_t index{ firstIndex }; index < lastIndex; index++)
+			cluster.sphereRadius = std::max(cluster.sphereRadius, (vertices[indices[index]].pos - cluster.sphereCenter).Magnitude());
+
+		// Front faces wind clockwise when seen from the camera, so this normal points towards it
+		std::vector<Vector3> faceNormals{};
+		Vector3 normalSum{};
+
+		for (uint32_t index{ firstIndex }; index < lastIndex; index += 3)
+		{
+			const Vector3& position0{ vertices[indices[index]].pos };
+			Vector3 faceNormal{ Vector3::Cross(vertices[indices[index + 1]].pos - position0, vertices[indices[index + 2]].pos - position0) };
+
+			// Degenerate triangles are never drawn
+			if (faceNormal.Normalize() <= 0.0f)
+				continue;
+
+			faceNormals.push_back(faceNormal);
+			normalSum += faceNormal;
+		}
+
+		cluster.hasNormalCone = false;
+		if (faceNormals.empty() or normalSum.Normalize() <= 0.0f)
+			return;
+
+		float minDot{ 1.0f };
+		for (const Vector3& faceNormal : faceNormals)
+			minDot = std::min(minDot, Vector3::Dot(faceNormal, normalSum));
+
+		// Normals that are more than 90 degrees apart don't fit a cone that can be culled
+		if (minDot <= 0.0f)
+			return;
+
+		cluster.hasNormalCone = true;
+		cluster.coneAxis = normalSum;
+		cluster.coneCutoff = std::sqrt(1.0f - minDot * minDot);
 	}
 
 
@@ -203,20 +383,4 @@ namespace dae
 
 		m_WorldMatrix = scaleMatrix * rotateMatrix * translationMatrix;
 	}
-
-	void Mesh::ResetTransformedVertices()
-	{
-		assert(m_VerticesModel.size() == m_VerticesTransformed.size());
-
-		for (size_t i = 0; i < m_VerticesModel.size(); i++)
-		{
-			m_VerticesTransformed[i]->pos = { m_VerticesModel[i].pos.x,m_VerticesModel[i].pos.y,m_VerticesModel[i].pos.z,1.0f };
-			m_VerticesTransformed[i]->uv = m_VerticesModel[i].uv;
-			m_VerticesTransformed[i]->normal = m_VerticesModel[i].normal;
-			m_VerticesTransformed[i]->tangent = m_VerticesModel[i].tangent;
-			m_VerticesTransformed[i]->viewDirection = m_VerticesModel[i].viewDirection;
-			m_VerticesTransformed[i]->materialIndex = m_VerticesModel[i].materialIndex;
-			m_VerticesTransformed[i]->color = m_VerticesModel[i].color;
-		}
-	}
 }
@@ -8,6 +8,33 @@ namespace dae
 {
 	class Renderer;
 
+	// Part of a mesh that is culled as a whole, it owns a continuous range of triangles and vertices
+	struct MeshCluster
+	{
+		uint32_t triangleStart;
+		uint32_t triangleCount;
+		uint32_t vertexStart;
+		uint32_t vertexCount;	// Padded to the vertex batch size, so batches never reach into the next cluster
+
+		// Model space bounds
+		Vector3 boundsMin;
+		Vector3 boundsMax;
+		Vector3 sphereCenter;
+		float sphereRadius;
+
+		// Every face normal is within the cone, clusters whose cone is too wide can't be back face culled
+		bool hasNormalCone;
+		Vector3 coneAxis;
+		float coneCutoff;	// Sine of the angle of the cone
+	};
+
+	// Vertices that are transformed together on one thread
+	struct VertexRange
+	{
+		uint32_t start;
+		uint32_t end;
+	};
+
 	class Mesh
 	{
 	public:
@@ -29,13 +56,35 @@ namespace dae
 
 		void AddYawRotation(float yawDelta);
 
+		uint32_t GetTriangleCount() const { return static_cast<uint32_t>(m_Indices.size() / 3); }
+
+		// Colors used by the weights render mode, picked from the index of the vertex
+		static ColorRGB GetVertexColor(uint32_t vertexIndex);
+
 	private:
 
-		std::vector<VertexModel> m_VerticesModel;
-		std::vector<std::shared_ptr<VertexTransformed>> m_VerticesTransformed;
-		std::vector<Triangle> m_Triangles;
+		VertexBuffer m_Vertices;
+		TransformedVertexBuffer m_VerticesTransformed;
 
+		// Three per triangle, strips are turned into lists when loaded
 		std::vector<uint32_t> m_Indices;
+		std::vector<int> m_TriangleMaterialIndices;
+
+		// Triangles are grouped per material and facing direction and split in space when loaded
+		static constexpr uint32_t MAX_CLUSTER_TRIANGLES{ 128 };
+		std::vector<MeshCluster> m_Clusters;
+
+		// Vertex blocks of the clusters that passed culling, blocks are transformed in parallel
+		static constexpr uint32_t VERTEX_BLOCK_SIZE{ 1024 };
+		std::vector<VertexRange> m_VertexBlocks;
+
+		// Order the triangles are rasterized in, rebuilt every frame from the clusters that passed culling
+		std::vector<uint32_t> m_TriangleOrder;
+
+		// Triangles cut by the near plane or the guard band, rebuilt every frame with three vertices each
+		// They are numbered after the triangles of the index buffer
+		std::vector<VertexTransformed> m_ClippedVertices;
+		std::vector<uint32_t> m_ClippedTriangleSources;	// Triangle every clipped triangle was cut from
 
 		std::vector<Material*> m_MaterialPtrs;
 		PrimitiveTopology m_PrimitiveTopology;
@@ -52,10 +101,10 @@ namespace dae
 		Vector3 m_Scale;
 		Vector3 m_Position;
 
-		void InitializeVertices();
-		void InitializeVertexColors();
-		void InitializeTriangles();
+		void InitializeVertices(const std::vector<VertexModel>& vertices);
+		void InitializeTriangles(const std::vector<VertexModel>& vertices);
+		void InitializeClusters(std::vector<VertexModel>& vertices);
+		void InitializeClusterCone(MeshCluster& cluster, const std::vector<VertexModel>& vertices, const std::vector<uint32_t>& indices) const;
 		void UpdateWorldMatrix();
-		void ResetTransformedVertices();
 	};
 }
@@ -6,10 +6,16 @@
 #include "Renderer.h"
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cmath>
 #include <execution>
 #include <iostream>
 #include <format>
+#include <immintrin.h>
+#include <numeric>
+#include <thread>
 
 #include "Camera.h"
 #include "Maths.h"
@@ -18,8 +24,7 @@
 #include "Texture.h"
 #include "Utils.h"
 
-//#define MULTI_THREAD_PIXELS
-#define MULTI_THREAD_TRIANGLE
+#define MULTI_THREAD_TILES
 //#define DOUBLE_SIDED
 //#define SORT_TRIANGLES
 #define RENDER_OPACITY_CUTOUT
@@ -44,14 +49,44 @@ m_UseLinearDepth(true)
 	m_BackBufferPtr = SDL_CreateRGBSurface(0, m_ScreenWidth, m_ScreenHeight, 32, 0, 0, 0, 0);
 	m_BackBufferPixelsPtr = static_cast<uint32_t*>(m_BackBufferPtr->pixels);
 	m_pDepthBufferPixels = new float[m_ScreenWidth * m_ScreenHeight];
+	m_pVisibilityBuffer = new uint32_t[m_ScreenWidth * m_ScreenHeight];
+	m_pColorBufferR = new float[m_ScreenWidth * m_ScreenHeight];
+	m_pColorBufferG = new float[m_ScreenWidth * m_ScreenHeight];
+	m_pColorBufferB = new float[m_ScreenWidth * m_ScreenHeight];
 
+	m_ScreenRows.resize(m_ScreenHeight);
+	std::iota(m_ScreenRows.begin(), m_ScreenRows.end(), 0);
 
-#ifdef MULTI_THREAD_PIXELS
-	const int maxPixelLength{ std::max(m_ScreenWidth, m_ScreenHeight) };
-	m_Integers.resize(maxPixelLength);
-	// fill with incrementing values
-	std::iota(m_Integers.begin(), m_Integers.end(), 1);
-#endif
+
+	// Split the screen in tiles, tiles on the right and bottom edge can be smaller
+	m_TileCountX = (m_ScreenWidth + TILE_SIZE - 1) / TILE_SIZE;
+	m_TileCountY = (m_ScreenHeight + TILE_SIZE - 1) / TILE_SIZE;
+
+	for (int tileY{}; tileY < m_TileCountY; tileY++)
+	{
+		for (int tileX{}; tileX < m_TileCountX; tileX++)
+		{
+			m_Tiles.push_back({
+				static_cast<int>(m_Tiles.size()),
+				tileX * TILE_SIZE,
+				tileY * TILE_SIZE,
+				std::min((tileX + 1) * TILE_SIZE, m_ScreenWidth),
+				std::min((tileY + 1) * TILE_SIZE, m_ScreenHeight)
+			});
+		}
+	}
+
+	// Every bin chunk gets its own bins, so binning needs no locks
+	m_BinChunks.resize(std::max(1u, std::thread::hardware_concurrency()));
+	std::iota(m_BinChunks.begin(), m_BinChunks.end(), 0);
+	m_TileBins.resize(m_BinChunks.size() * m_Tiles.size());
+	m_TileLights.resize(m_Tiles.size());
+
+	// Farthest depth per raster block and per tile
+	m_DepthBlockCountX = (m_ScreenWidth + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+	m_DepthBlockCountY = (m_ScreenHeight + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+	m_pBlockMaxDepth = new float[m_DepthBlockCountX * m_DepthBlockCountY];
+	m_pTileMaxDepth = new float[m_Tiles.size()];
 
 
 	m_MaterialPtrMap.insert({ "default",new Material {
@@ -63,6 +98,7 @@ m_UseLinearDepth(true)
 	m_MaterialPtrMap.insert({ "uvGrid",new Material {
 	Texture::LoadFromFile("uv_grid_2.png"),
 	}});
+	m_pUVGridTexture = m_MaterialPtrMap["uvGrid"]->diffuse;
 
 
 
@@ -79,14 +115,18 @@ Renderer::~Renderer()
 			continue;
 
 		delete pair.second->diffuse;
-		delete pair.second->opacity;
 		delete pair.second->normal;
-		delete pair.second->specular;
-		delete pair.second->gloss;
+		delete pair.second->surface;
 		delete pair.second;
 	}
 
 	delete[] m_pDepthBufferPixels;
+	delete[] m_pVisibilityBuffer;
+	delete[] m_pBlockMaxDepth;
+	delete[] m_pTileMaxDepth;
+	delete[] m_pColorBufferR;
+	delete[] m_pColorBufferG;
+	delete[] m_pColorBufferB;
 }
 
 
@@ -106,10 +146,8 @@ void Renderer::InitializeSceneAssignment()
 
 	m_MaterialPtrMap.insert({ "bike",new Material {
 		Texture::LoadFromFile("vehicle_diffuse.png"),
-		nullptr,
 		Texture::LoadFromFile("vehicle_normal.png"),
-		Texture::LoadFromFile("vehicle_specular.png"),
-		Texture::LoadFromFile("vehicle_gloss.png"),
+		Texture::LoadPacked("vehicle_specular.png", "vehicle_gloss.png", ""),
 	} });
 
 
@@ -245,14 +283,49 @@ void Renderer::Render()
 	
 	// Clear depth buffer
 	std::fill_n(m_pDepthBufferPixels, m_ScreenWidth * m_ScreenHeight, std::numeric_limits<float>::max());
-	// Clear screen buffer
-	SDL_FillRect(m_BackBufferPtr, nullptr, SDL_MapRGB(m_BackBufferPtr->format, m_ClearColor, m_ClearColor, m_ClearColor));
+	std::fill_n(m_pBlockMaxDepth, m_DepthBlockCountX * m_DepthBlockCountY, std::numeric_limits<float>::max());
+	std::fill_n(m_pTileMaxDepth, m_Tiles.size(), std::numeric_limits<float>::max());
+
+	// Clear color buffer, half a step up so the clear color comes out as the same byte
+	const float clearValue{ (static_cast<float>(m_ClearColor) + 0.5f) / 255.0f };
+	std::fill_n(m_pColorBufferR, m_ScreenWidth * m_ScreenHeight, clearValue);
+	std::fill_n(m_pColorBufferG, m_ScreenWidth * m_ScreenHeight, clearValue);
+	std::fill_n(m_pColorBufferB, m_ScreenWidth * m_ScreenHeight, clearValue);
+
 
+	// In visibility buffer mode meshes only write depth and triangle ids, shading happens once per pixel after
+	m_IsShadingDeferred = m_UseVisibilityBuffer and CanUseVisibilityBuffer();
+	if (m_IsShadingDeferred)
+		std::fill_n(m_pVisibilityBuffer, m_ScreenWidth * m_ScreenHeight, INVALID_VISIBILITY_ID);
 
 	// Render all meshes
-	for (Mesh& mesh : m_WorldMeshes)
-		RasterizeMesh(mesh);
-	
+	m_DrawnClusterCount = 0;
+	m_CulledClusterCount = 0;
+	m_BackFacingClusterCount = 0;
+
+	// Shading right away can't know the depth of a tile yet, so only the sides of the tiles cull lights
+	if (!m_IsShadingDeferred)
+		CullLights(false);
+
+	for (uint32_t meshIndex{}; meshIndex < m_WorldMeshes.size(); meshIndex++)
+		RasterizeMesh(m_WorldMeshes[meshIndex], meshIndex);
+
+	if (m_IsShadingDeferred)
+	{
+		CullLights(true);
+		ShadeVisibilityBuffer();
+	}
+
+
+	// Turn the colors into pixels, the surface format is only looked at once
+	m_PixelResolver.SetFormat(m_BackBufferPtr->format);
+
+	std::for_each(std::execution::par, m_ScreenRows.begin(), m_ScreenRows.end(), [this](int pixelY)
+		{
+			const int rowStart{ pixelY * m_ScreenWidth };
+			m_PixelResolver.ResolveRow(m_pColorBufferR + rowStart, m_pColorBufferG + rowStart, m_pColorBufferB + rowStart, m_BackBufferPixelsPtr + rowStart, m_ScreenWidth);
+		});
+
 
 	//Update SDL Surface
 	SDL_UnlockSurface(m_BackBufferPtr);
@@ -280,6 +353,24 @@ void Renderer::ToggleLinearDepth()
 	std::cout << std::boolalpha << "Linear Depth-> " << m_UseLinearDepth << std::endl;
 }
 
+void Renderer::ToggleToneMapping()
+{
+	m_PixelResolver.ToggleToneMapping();
+	std::cout << std::boolalpha << "Tone Mapping -> " << m_PixelResolver.IsToneMappingEnabled() << std::endl;
+}
+
+void Renderer::ToggleVisibilityBuffer()
+{
+	m_UseVisibilityBuffer = !m_UseVisibilityBuffer;
+	std::cout << std::boolalpha << "Visibility Buffer -> " << m_UseVisibilityBuffer << std::endl;
+}
+
+void Renderer::ToggleGammaCorrection()
+{
+	m_PixelResolver.ToggleGammaCorrection();
+	std::cout << std::boolalpha << "Gamma Correction -> " << m_PixelResolver.IsGammaCorrectionEnabled() << std::endl;
+}
+
 void Renderer::SetRenderMode(DebugRenderMode mode)
 {
 	m_RenderMode = mode;
@@ -301,6 +392,176 @@ void Renderer::CycleRenderMode()
 }
 
 
+bool Renderer::CanUseVisibilityBuffer() const
+{
+	// Ids of meshes past the last index would alias, forward shading has no such limit
+	if (m_WorldMeshes.size() > MAX_VISIBILITY_MESH_INDEX + 1)
+		return false;
+
+	// A clipped triangle turns into at most MAX_CLIP_VERTICES - 2 new ones, which get ids after the original triangles
+	return std::ranges::all_of(m_WorldMeshes, [](const Mesh& mesh)
+		{
+			return uint64_t{ mesh.GetTriangleCount() } * (MAX_CLIP_VERTICES - 1) <= VISIBILITY_TRIANGLE_MASK;
+		});
+}
+
+void Renderer::CullLights(bool useTileDepth)
+{
+	const Camera& camera{ *m_CameraPtr };
+	const float nearPlane{ camera.m_NearClippingPlane };
+	const float farPlane{ camera.m_FarClippingPlane };
+
+	// Point lights as spheres in view space, the radius is where they stop mattering
+	std::vector<Vector4> viewSpaceLights(m_WorldLights.size());
+	for (size_t lightIndex{}; lightIndex < m_WorldLights.size(); lightIndex++)
+	{
+		const Light& light{ m_WorldLights[lightIndex] };
+		viewSpaceLights[lightIndex] = { camera.m_InvViewMatrix.TransformPoint(light.GetOrigin()), light.GetRange(LIGHT_CUTOFF_RADIANCE) };
+	}
+
+	// A point is inside the side planes of a tile when x / z and y / z are within the slopes of its edges
+	const float slopeScaleX{ 1.0f / camera.m_ProjectionMatrix[0].x };
+	const float slopeScaleY{ 1.0f / camera.m_ProjectionMatrix[1].y };
+
+	std::for_each(std::execution::par, m_Tiles.begin(), m_Tiles.end(), [&](const Tile& tile)
+		{
+			std::vector<uint32_t>& tileLights{ m_TileLights[tile.index] };
+			tileLights.clear();
+
+			float minViewDepth{ nearPlane };
+			float maxViewDepth{ farPlane };
+
+			if (useTileDepth)
+			{
+				float minDepth{ std::numeric_limits<float>::max() };
+				float maxDepth{ std::numeric_limits<float>::lowest() };
+
+				for (int pixelY{ tile.minY }; pixelY < tile.maxY; pixelY++)
+				{
+					for (int pixelX{ tile.minX }; pixelX < tile.maxX; pixelX++)
+					{
+						const float depth{ m_pDepthBufferPixels[pixelX + pixelY * m_ScreenWidth] };
+
+						// Pixels without a triangle keep the cleared depth
+						if (depth == std::numeric_limits<float>::max())
+							continue;
+
+						minDepth = std::min(minDepth, depth);
+						maxDepth = std::max(maxDepth, depth);
+					}
+				}
+
+				// Nothing to shade
+				if (minDepth > maxDepth)
+					return;
+
+				// Inverse of the projection of the depth
+				const auto toViewDepth = [&](float depth) { return farPlane * nearPlane / (farPlane - depth * (farPlane - nearPlane)); };
+				minViewDepth = toViewDepth(minDepth);
+				maxViewDepth = toViewDepth(maxDepth);
+			}
+
+			const float leftSlope{ (2.0f * static_cast<float>(tile.minX) / static_cast<float>(m_ScreenWidth) - 1.0f) * slopeScaleX };
+			const float rightSlope{ (2.0f * static_cast<float>(tile.maxX) / static_cast<float>(m_ScreenWidth) - 1.0f) * slopeScaleX };
+			const float topSlope{ (1.0f - 2.0f * static_cast<float>(tile.minY) / static_cast<float>(m_ScreenHeight)) * slopeScaleY };
+			const float bottomSlope{ (1.0f - 2.0f * static_cast<float>(tile.maxY) / static_cast<float>(m_ScreenHeight)) * slopeScaleY };
+
+			// Distance of a point to the plane through the camera with that slope, positive on the side of the tile
+			const auto planeDistance = [](float position, float depth, float slope)
+			{
+				return (position - slope * depth) / std::sqrt(1.0f + slope * slope);
+			};
+
+			for (uint32_t lightIndex{}; lightIndex < viewSpaceLights.size(); lightIndex++)
+			{
+				const Vector4& sphere{ viewSpaceLights[lightIndex] };
+				const float radius{ sphere.w };
+
+				const bool isOutside
+				{
+					sphere.z + radius < minViewDepth or
+					sphere.z - radius > maxViewDepth or
+					planeDistance(sphere.x, sphere.z, leftSlope) < -radius or
+					-planeDistance(sphere.x, sphere.z, rightSlope) < -radius or
+					planeDistance(sphere.y, sphere.z, bottomSlope) < -radius or
+					-planeDistance(sphere.y, sphere.z, topSlope) < -radius
+				};
+
+				if (!isOutside)
+					tileLights.push_back(lightIndex);
+			}
+		});
+}
+
+void Renderer::CullClusters(Mesh& mesh)
+{
+	// Bounds are tested in clip space, the same way triangles are rejected
+	const Matrix modelToClipMatrix = mesh.m_WorldMatrix * m_CameraPtr->m_InvViewMatrix * m_CameraPtr->m_ProjectionMatrix;
+
+	// Cones are tested in model space, a mirrored mesh would turn its faces around
+	const Vector3 cameraPosition{ Matrix::Inverse(mesh.m_WorldMatrix).TransformPoint(m_CameraPtr->m_Origin) };
+	const bool isMirrored{ Vector3::Dot(Vector3::Cross(mesh.m_WorldMatrix.GetAxisX(), mesh.m_WorldMatrix.GetAxisY()), mesh.m_WorldMatrix.GetAxisZ()) < 0.0f };
+
+	mesh.m_TriangleOrder.clear();
+	mesh.m_VertexBlocks.clear();
+
+	for (const MeshCluster& cluster : mesh.m_Clusters)
+	{
+		// Culled when every corner of the bounds is outside of the same plane
+		uint32_t sharedOutcode{ CLIP_FRUSTUM };
+		for (int corner{}; corner < 8; corner++)
+		{
+			const Vector4 clipPosition{ modelToClipMatrix.TransformPoint(
+				corner & 1 ? cluster.boundsMax.x : cluster.boundsMin.x,
+				corner & 2 ? cluster.boundsMax.y : cluster.boundsMin.y,
+				corner & 4 ? cluster.boundsMax.z : cluster.boundsMin.z,
+				1.0f) };
+
+			sharedOutcode &= GetFrustumOutcode(clipPosition);
+		}
+
+		if (sharedOutcode != 0)
+		{
+			m_CulledClusterCount++;
+			continue;
+		}
+
+#ifndef DOUBLE_SIDED
+		// Back facing when the camera sees every face normal of the cone from behind, from any point of the sphere
+		if (cluster.hasNormalCone and !isMirrored)
+		{
+			const Vector3 cameraToCenter{ cluster.sphereCenter - cameraPosition };
+			if (Vector3::Dot(cameraToCenter, cluster.coneAxis) > cluster.coneCutoff * cameraToCenter.Magnitude() + cluster.sphereRadius)
+			{
+				m_BackFacingClusterCount++;
+				continue;
+			}
+		}
+#endif
+
+		m_DrawnClusterCount++;
+
+		for (uint32_t triangleIndex{ cluster.triangleStart }; triangleIndex < cluster.triangleStart + cluster.triangleCount; triangleIndex++)
+			mesh.m_TriangleOrder.push_back(triangleIndex);
+
+		const uint32_t clusterEnd{ cluster.vertexStart + cluster.vertexCount };
+		for (uint32_t blockStart{ cluster.vertexStart }; blockStart < clusterEnd; blockStart += Mesh::VERTEX_BLOCK_SIZE)
+			mesh.m_VertexBlocks.push_back({ blockStart, std::min(blockStart + Mesh::VERTEX_BLOCK_SIZE, clusterEnd) });
+	}
+}
+
+uint32_t Renderer::GetFrustumOutcode(const Vector4& clipPosition)
+{
+	uint32_t outcode{};
+	if (clipPosition.x < -clipPosition.w) outcode |= CLIP_LEFT;
+	if (clipPosition.x > clipPosition.w) outcode |= CLIP_RIGHT;
+	if (clipPosition.y < -clipPosition.w) outcode |= CLIP_BOTTOM;
+	if (clipPosition.y > clipPosition.w) outcode |= CLIP_TOP;
+	if (clipPosition.z < 0.0f) outcode |= CLIP_NEAR;
+	if (clipPosition.z > clipPosition.w) outcode |= CLIP_FAR;
+	return outcode;
+}
+
 void Renderer::TransformMesh(Mesh& mesh) const
 {
 	// SPACES
@@ -316,311 +577,1054 @@ void Renderer::TransformMesh(Mesh& mesh) const
 	// For the view direction the camera is in world and we only need to translate the vertex from model -> world
 
 
-	// Make sure the transformed vertices are back in the same state as the model vertices
-	// This is done because we apply matrix transformations on the transformed vertices
-	mesh.ResetTransformedVertices();
-
 	const Matrix worldToViewProjectionMatrix = m_CameraPtr->m_InvViewMatrix * m_CameraPtr->m_ProjectionMatrix;
 
-	for (const std::shared_ptr<VertexTransformed>& vertex : mesh.m_VerticesTransformed)
+	// Blocks write to their own part of the transformed arrays, so they can run on any thread
+	std::for_each(std::execution::par, mesh.m_VertexBlocks.begin(), mesh.m_VertexBlocks.end(), [&](const VertexRange& block)
+		{
+			TransformVertexBlock(mesh, worldToViewProjectionMatrix, block);
+		});
+}
+
+void Renderer::TransformVertexBlock(Mesh& mesh, const Matrix& worldToViewProjectionMatrix, const VertexRange& block) const
+{
+	const VertexBuffer& vertices{ mesh.m_Vertices };
+	TransformedVertexBuffer& transformed{ mesh.m_VerticesTransformed };
+
+	// Every matrix element is broadcast once, each lane of a register is one vertex
+	struct BroadcastMatrix
 	{
-		// Convert vertex to world
-		vertex->pos = mesh.m_WorldMatrix.TransformPoint(vertex->pos);
+		__m128 m[4][4];
+	};
+
+	const auto broadcast = [](const Matrix& matrix)
+	{
+		BroadcastMatrix result{};
+		for (int row{}; row < 4; row++)
+		{
+			const Vector4 rowValues{ matrix[row] };
+			result.m[row][0] = _mm_set1_ps(rowValues.x);
+			result.m[row][1] = _mm_set1_ps(rowValues.y);
+			result.m[row][2] = _mm_set1_ps(rowValues.z);
+			result.m[row][3] = _mm_set1_ps(rowValues.w);
+		}
+		return result;
+	};
 
-		// Store world pos, this is used later on for lighting
-		vertex->worldPos = vertex->pos.GetXYZ(); 
+	const BroadcastMatrix world{ broadcast(mesh.m_WorldMatrix) };
+	const BroadcastMatrix viewProjection{ broadcast(worldToViewProjectionMatrix) };
 
-		// Convert normal to world
-		// Note we use transform vector
-		vertex->normal  = mesh.m_WorldMatrix.TransformVector(vertex->normal ).Normalized();
-		vertex->tangent = mesh.m_WorldMatrix.TransformVector(vertex->tangent).Normalized();
+	// Same order of operations as Matrix::TransformVector and TransformPoint
+	const auto transformVector = [](const BroadcastMatrix& matrix, __m128 x, __m128 y, __m128 z, int column)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(matrix.m[0][column], x), _mm_mul_ps(matrix.m[1][column], y)), _mm_mul_ps(matrix.m[2][column], z));
+	};
 
-		// Calculate view direction based on vertex in world
-		vertex->viewDirection = (vertex->worldPos - m_CameraPtr->m_Origin).Normalized();
+	const auto transformPoint = [&](const BroadcastMatrix& matrix, __m128 x, __m128 y, __m128 z, int column)
+	{
+		return _mm_add_ps(transformVector(matrix, x, y, z, column), matrix.m[3][column]);
+	};
 
-		// Transform vertex to view
-		vertex->pos = worldToViewProjectionMatrix.TransformPoint(vertex->pos);
+	const auto normalize = [](__m128& x, __m128& y, __m128& z)
+	{
+		const __m128 magnitude{ _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z))) };
+		x = _mm_div_ps(x, magnitude);
+		y = _mm_div_ps(y, magnitude);
+		z = _mm_div_ps(z, magnitude);
+	};
+
+	const __m128 zero{ _mm_setzero_ps() };
+	const __m128 one{ _mm_set1_ps(1.0f) };
+	const __m128 half{ _mm_set1_ps(0.5f) };
+	const __m128 guardBand{ _mm_set1_ps(GUARD_BAND) };
+	const __m128 screenWidth{ _mm_set1_ps(static_cast<float>(m_ScreenWidth)) };
+	const __m128 screenHeight{ _mm_set1_ps(static_cast<float>(m_ScreenHeight)) };
+	const __m128 cameraX{ _mm_set1_ps(m_CameraPtr->m_Origin.x) };
+	const __m128 cameraY{ _mm_set1_ps(m_CameraPtr->m_Origin.y) };
+	const __m128 cameraZ{ _mm_set1_ps(m_CameraPtr->m_Origin.z) };
+
+	// Clusters are padded, so blocks are always whole batches
+	for (uint32_t i{ block.start }; i < block.end; i += VERTEX_BATCH_SIZE)
+	{
+		// Convert vertex to world
+		const __m128 modelX{ _mm_loadu_ps(&vertices.positionX[i]) };
+		const __m128 modelY{ _mm_loadu_ps(&vertices.positionY[i]) };
+		const __m128 modelZ{ _mm_loadu_ps(&vertices.positionZ[i]) };
+
+		const __m128 worldX{ transformPoint(world, modelX, modelY, modelZ, 0) };
+		const __m128 worldY{ transformPoint(world, modelX, modelY, modelZ, 1) };
+		const __m128 worldZ{ transformPoint(world, modelX, modelY, modelZ, 2) };
+
+		// Convert normal and tangent to world, only rotation and scale are used
+		const __m128 modelNormalX{ _mm_loadu_ps(&vertices.normalX[i]) };
+		const __m128 modelNormalY{ _mm_loadu_ps(&vertices.normalY[i]) };
+		const __m128 modelNormalZ{ _mm_loadu_ps(&vertices.normalZ[i]) };
+		__m128 normalX{ transformVector(world, modelNormalX, modelNormalY, modelNormalZ, 0) };
+		__m128 normalY{ transformVector(world, modelNormalX, modelNormalY, modelNormalZ, 1) };
+		__m128 normalZ{ transformVector(world, modelNormalX, modelNormalY, modelNormalZ, 2) };
+		normalize(normalX, normalY, normalZ);
+
+		const __m128 modelTangentX{ _mm_loadu_ps(&vertices.tangentX[i]) };
+		const __m128 modelTangentY{ _mm_loadu_ps(&vertices.tangentY[i]) };
+		const __m128 modelTangentZ{ _mm_loadu_ps(&vertices.tangentZ[i]) };
+		__m128 tangentX{ transformVector(world, modelTangentX, modelTangentY, modelTangentZ, 0) };
+		__m128 tangentY{ transformVector(world, modelTangentX, modelTangentY, modelTangentZ, 1) };
+		__m128 tangentZ{ transformVector(world, modelTangentX, modelTangentY, modelTangentZ, 2) };
+		normalize(tangentX, tangentY, tangentZ);
 
-		// Apply perspective divide  
-		vertex->pos.x /= vertex->pos.w;
-		vertex->pos.y /= vertex->pos.w;
-		vertex->pos.z /= vertex->pos.w;
+		// Calculate view direction based on vertex in world
+		__m128 viewDirectionX{ _mm_sub_ps(worldX, cameraX) };
+		__m128 viewDirectionY{ _mm_sub_ps(worldY, cameraY) };
+		__m128 viewDirectionZ{ _mm_sub_ps(worldZ, cameraZ) };
+		normalize(viewDirectionX, viewDirectionY, viewDirectionZ);
+
+		// Transform vertex to clip space
+		const __m128 clipX{ transformPoint(viewProjection, worldX, worldY, worldZ, 0) };
+		const __m128 clipY{ transformPoint(viewProjection, worldX, worldY, worldZ, 1) };
+		const __m128 clipZ{ transformPoint(viewProjection, worldX, worldY, worldZ, 2) };
+		const __m128 clipW{ transformPoint(viewProjection, worldX, worldY, worldZ, 3) };
+
+		// Test against every plane, triangles are rejected or clipped from these bits
+		const __m128 negativeW{ _mm_sub_ps(zero, clipW) };
+		const __m128 guardW{ _mm_mul_ps(clipW, guardBand) };
+		const __m128 negativeGuardW{ _mm_sub_ps(zero, guardW) };
+
+		__m128i outcodes{ _mm_setzero_si128() };
+		const auto addPlane = [&outcodes](__m128 isOutside, uint32_t plane)
+		{
+			outcodes = _mm_or_si128(outcodes, _mm_and_si128(_mm_castps_si128(isOutside), _mm_set1_epi32(static_cast<int>(plane))));
+		};
 
-		vertex->pos.z = 1.0f / vertex->pos.z;
+		addPlane(_mm_cmplt_ps(clipX, negativeW), CLIP_LEFT);
+		addPlane(_mm_cmpgt_ps(clipX, clipW), CLIP_RIGHT);
+		addPlane(_mm_cmplt_ps(clipY, negativeW), CLIP_BOTTOM);
+		addPlane(_mm_cmpgt_ps(clipY, clipW), CLIP_TOP);
+		addPlane(_mm_cmplt_ps(clipZ, zero), CLIP_NEAR);
+		addPlane(_mm_cmpgt_ps(clipZ, clipW), CLIP_FAR);
+		addPlane(_mm_cmplt_ps(clipX, negativeGuardW), CLIP_GUARD_LEFT);
+		addPlane(_mm_cmpgt_ps(clipX, guardW), CLIP_GUARD_RIGHT);
+		addPlane(_mm_cmplt_ps(clipY, negativeGuardW), CLIP_GUARD_BOTTOM);
+		addPlane(_mm_cmpgt_ps(clipY, guardW), CLIP_GUARD_TOP);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&transformed.outcodes[i]), outcodes);
+		_mm_storeu_ps(&transformed.clipX[i], clipX);
+		_mm_storeu_ps(&transformed.clipY[i], clipY);
+		_mm_storeu_ps(&transformed.clipZ[i], clipZ);
+
+		// Apply perspective divide
+		const __m128 ndcX{ _mm_div_ps(clipX, clipW) };
+		const __m128 ndcY{ _mm_div_ps(clipY, clipW) };
+		const __m128 ndcZ{ _mm_div_ps(clipZ, clipW) };
 
 		// Convert from NDC to screen
-		vertex->pos.x = (vertex->pos.x + 1.0f) / 2.0f * static_cast<float>(m_ScreenWidth);
-		vertex->pos.y = (1.0f - vertex->pos.y) / 2.0f * static_cast<float>(m_ScreenHeight);
+		_mm_storeu_ps(&transformed.positionX[i], _mm_mul_ps(_mm_mul_ps(_mm_add_ps(ndcX, one), half), screenWidth));
+		_mm_storeu_ps(&transformed.positionY[i], _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(one, ndcY), half), screenHeight));
+		_mm_storeu_ps(&transformed.positionZ[i], _mm_div_ps(one, ndcZ));
+		_mm_storeu_ps(&transformed.positionW[i], clipW);
+
+		_mm_storeu_ps(&transformed.worldX[i], worldX);
+		_mm_storeu_ps(&transformed.worldY[i], worldY);
+		_mm_storeu_ps(&transformed.worldZ[i], worldZ);
+		_mm_storeu_ps(&transformed.normalX[i], normalX);
+		_mm_storeu_ps(&transformed.normalY[i], normalY);
+		_mm_storeu_ps(&transformed.normalZ[i], normalZ);
+		_mm_storeu_ps(&transformed.tangentX[i], tangentX);
+		_mm_storeu_ps(&transformed.tangentY[i], tangentY);
+		_mm_storeu_ps(&transformed.tangentZ[i], tangentZ);
+		_mm_storeu_ps(&transformed.viewDirectionX[i], viewDirectionX);
+		_mm_storeu_ps(&transformed.viewDirectionY[i], viewDirectionY);
+		_mm_storeu_ps(&transformed.viewDirectionZ[i], viewDirectionZ);
 	}
 }
 
 
-void Renderer::RasterizeMesh(Mesh& mesh) const
+void Renderer::RasterizeMesh(Mesh& mesh, uint32_t meshIndex)
 {
+	// Clusters outside of the frustum are never transformed
+	CullClusters(mesh);
+	if (mesh.m_TriangleOrder.empty())
+		return;
+
 	TransformMesh(mesh);
 
 #ifdef SORT_TRIANGLES
-	auto compareTriangles = [](const Triangle& triangle1, const Triangle& triangle2) {
-		// Assuming Vector4 has a member pos.z
+	const TransformedVertexBuffer& transformed{ mesh.m_VerticesTransformed };
+
+	auto compareTriangles = [&](uint32_t triangle1, uint32_t triangle2) {
 
 		const float triangle1Z
 		{
-				triangle1.vertex0->pos.z +
-				triangle1.vertex1->pos.z +
-				triangle1.vertex2->pos.z 
+				transformed.positionZ[mesh.m_Indices[triangle1 * 3]] +
+				transformed.positionZ[mesh.m_Indices[triangle1 * 3 + 1]] +
+				transformed.positionZ[mesh.m_Indices[triangle1 * 3 + 2]]
 		};
 
 		const float triangle2Z
 		{
-				triangle2.vertex0->pos.z +
-				triangle2.vertex1->pos.z +
-				triangle2.vertex2->pos.z
+				transformed.positionZ[mesh.m_Indices[triangle2 * 3]] +
+				transformed.positionZ[mesh.m_Indices[triangle2 * 3 + 1]] +
+				transformed.positionZ[mesh.m_Indices[triangle2 * 3 + 2]]
 		};
 
 		return triangle1Z >= triangle2Z;
 
 		};
 
-	std::ranges::sort(mesh.m_Triangles, compareTriangles);
+	std::ranges::sort(mesh.m_TriangleOrder, compareTriangles);
 #endif
 
-#ifdef MULTI_THREAD_TRIANGLE
-	std::for_each(std::execution::par, mesh.m_Triangles.begin(), mesh.m_Triangles.end(), [this,mesh](const Triangle& triangle)
+	ClipTriangles(mesh);
+
+	// The mesh and triangle have to fit in a visibility id, clipped triangles included
+	assert(not m_IsShadingDeferred or (meshIndex <= MAX_VISIBILITY_MESH_INDEX and mesh.GetTriangleCount() + mesh.m_ClippedTriangleSources.size() <= VISIBILITY_TRIANGLE_MASK));
+
+	BinTriangles(mesh);
+
+	// Each tile only touches its own pixels, so tiles can run on any thread
+	// Chunks are visited in order, so every pixel sees its triangles in the order they were submitted
+	const auto rasterizeTile = [this, &mesh, meshIndex](const Tile& tile)
 		{
-			RasterizeTriangle(triangle, mesh.m_MaterialPtrs);
-		});
+			for (uint32_t chunk : m_BinChunks)
+			{
+				for (uint32_t triangleIndex : m_TileBins[chunk * m_Tiles.size() + tile.index])
+					RasterizeTriangle(mesh, meshIndex, triangleIndex, tile);
+			}
+		};
+
+#ifdef MULTI_THREAD_TILES
+	std::for_each(std::execution::par, m_Tiles.begin(), m_Tiles.end(), rasterizeTile);
 #else
-	for (Triangle& triangle : mesh.m_Triangles)
-		RasterizeTriangle(triangle, mesh.m_MaterialPtrs);
+	std::ranges::for_each(m_Tiles, rasterizeTile);
 #endif
 }
 
-void Renderer::RasterizeTriangle(const Triangle& triangle, const std::vector<Material*>& materialPtrs) const
+void Renderer::ClipTriangles(Mesh& mesh) const
 {
-	// Checking normal early for more performance
-	const Vector3 normal = Vector3::Cross
-	(
-		triangle.vertex1->pos - triangle.vertex0->pos,
-		triangle.vertex2->pos - triangle.vertex0->pos
-	);
+	const TransformedVertexBuffer& transformed{ mesh.m_VerticesTransformed };
 
-#ifndef DOUBLE_SIDED
-	if (normal.z <= 0.0f)
-		return;
-#endif
+	mesh.m_ClippedVertices.clear();
+	mesh.m_ClippedTriangleSources.clear();
 
+	// Positive on the inside of a plane
+	const auto getDistance = [](const Vector4& position, uint32_t plane)
+	{
+		switch (plane)
+		{
+		case CLIP_NEAR:			return position.z;
+		case CLIP_GUARD_LEFT:	return position.x + position.w * GUARD_BAND;
+		case CLIP_GUARD_RIGHT:	return position.w * GUARD_BAND - position.x;
+		case CLIP_GUARD_BOTTOM:	return position.y + position.w * GUARD_BAND;
+		default:				return position.w * GUARD_BAND - position.y;
+		}
+	};
 
-	if (triangle.vertex0->pos.w < 0.0f) return;
-	if (triangle.vertex1->pos.w < 0.0f) return;
-	if (triangle.vertex2->pos.w < 0.0f) return;
+	// Clip space is before the divide, so attributes can be interpolated linearly
+	const auto interpolate = [](const ClipVertex& start, const ClipVertex& end, float t)
+	{
+		ClipVertex result{};
+		result.clipPosition = start.clipPosition + (end.clipPosition - start.clipPosition) * t;
+		result.vertex.worldPos = start.vertex.worldPos + (end.vertex.worldPos - start.vertex.worldPos) * t;
+		result.vertex.uv = start.vertex.uv + (end.vertex.uv - start.vertex.uv) * t;
+		result.vertex.normal = start.vertex.normal + (end.vertex.normal - start.vertex.normal) * t;
+		result.vertex.tangent = start.vertex.tangent + (end.vertex.tangent - start.vertex.tangent) * t;
+		result.vertex.viewDirection = start.vertex.viewDirection + (end.vertex.viewDirection - start.vertex.viewDirection) * t;
+		result.vertex.color = start.vertex.color + (end.vertex.color - start.vertex.color) * t;
+		return result;
+	};
+
+	// Same conversion as the vertex stage
+	const auto toScreen = [this](const ClipVertex& clipVertex)
+	{
+		const Vector4& clipPosition{ clipVertex.clipPosition };
+		const float ndcX{ clipPosition.x / clipPosition.w };
+		const float ndcY{ clipPosition.y / clipPosition.w };
+		const float ndcZ{ clipPosition.z / clipPosition.w };
+
+		VertexTransformed vertex{ clipVertex.vertex };
+		vertex.pos = { (ndcX + 1.0f) * 0.5f * static_cast<float>(m_ScreenWidth), (1.0f - ndcY) * 0.5f * static_cast<float>(m_ScreenHeight), 1.0f / ndcZ, clipPosition.w };
+		return vertex;
+	};
+
+	// Clipped triangles keep the order of the triangles they were cut from
+	for (uint32_t triangleIndex : mesh.m_TriangleOrder)
+	{
+		const uint32_t indices[3]{ mesh.m_Indices[triangleIndex * 3], mesh.m_Indices[triangleIndex * 3 + 1], mesh.m_Indices[triangleIndex * 3 + 2] };
+		const uint32_t outcode0{ transformed.outcodes[indices[0]] };
+		const uint32_t outcode1{ transformed.outcodes[indices[1]] };
+		const uint32_t outcode2{ transformed.outcodes[indices[2]] };
 
+		// Fully outside of one plane
+		if ((outcode0 & outcode1 & outcode2) != 0)
+			continue;
 
-	// Adding the 1 pixel is done to prevent gaps in the triangles
-	constexpr int boundingBoxPadding{1};
-	int minX = static_cast<int>(std::min(triangle.vertex0->pos.x, std::min(triangle.vertex1->pos.x, triangle.vertex2->pos.x))) - boundingBoxPadding;
-	int maxX = static_cast<int>(std::max(triangle.vertex0->pos.x, std::max(triangle.vertex1->pos.x, triangle.vertex2->pos.x))) + boundingBoxPadding;
-	int minY = static_cast<int>(std::min(triangle.vertex0->pos.y, std::min(triangle.vertex1->pos.y, triangle.vertex2->pos.y))) - boundingBoxPadding;
-	int maxY = static_cast<int>(std::max(triangle.vertex0->pos.y, std::max(triangle.vertex1->pos.y, triangle.vertex2->pos.y))) + boundingBoxPadding;
+		// Within the guard band and in front of the near plane, binned as it is
+		const uint32_t crossedPlanes{ (outcode0 | outcode1 | outcode2) & CLIP_NEEDS_CLIPPING };
+		if (crossedPlanes == 0)
+			continue;
 
-	// Clamping is done so that the triangle is not rendered off the screen
-	minX = std::ranges::clamp(minX, 0, m_ScreenWidth);
-	maxX = std::ranges::clamp(maxX, 0, m_ScreenWidth);
-	minY = std::ranges::clamp(minY, 0, m_ScreenHeight);
-	maxY = std::ranges::clamp(maxY, 0, m_ScreenHeight);
+		ClipVertex polygon[MAX_CLIP_VERTICES];
+		ClipVertex clippedPolygon[MAX_CLIP_VERTICES];
+		int vertexCount{ 3 };
 
+		for (int vertexIndex{}; vertexIndex < 3; vertexIndex++)
+		{
+			const uint32_t index{ indices[vertexIndex] };
+			polygon[vertexIndex].clipPosition = { transformed.clipX[index], transformed.clipY[index], transformed.clipZ[index], transformed.positionW[index] };
+			polygon[vertexIndex].vertex = GatherVertex(mesh, index);
+		}
 
-	float signedAreaW0;
-	float signedAreaW1;
-	float signedAreaW2;
+		// Sutherland-Hodgman, only against the planes that are crossed
+		for (uint32_t plane : { CLIP_NEAR, CLIP_GUARD_LEFT, CLIP_GUARD_RIGHT, CLIP_GUARD_BOTTOM, CLIP_GUARD_TOP })
+		{
+			if ((crossedPlanes & plane) == 0)
+				continue;
 
-	// Looping all pixels within the bounding box
-	// This is done for optimization
-#ifdef MULTI_THREAD_PIXELS
+			int clippedCount{};
+			for (int vertexIndex{}; vertexIndex < vertexCount; vertexIndex++)
+			{
+				const ClipVertex& current{ polygon[vertexIndex] };
+				const ClipVertex& next{ polygon[(vertexIndex + 1) % vertexCount] };
+				const float currentDistance{ getDistance(current.clipPosition, plane) };
+				const float nextDistance{ getDistance(next.clipPosition, plane) };
 
-	std::for_each(std::execution::par, m_Integers.begin() + minX, m_Integers.begin() + maxX, [&](uint32_t pixelX)
-		{
-#else
-	for (int pixelX{ minX }; pixelX < maxX; pixelX++)
-	{
-#endif
-		for (int pixelY{ minY }; pixelY < maxY; pixelY++)
+				if (currentDistance >= 0.0f)
+					clippedPolygon[clippedCount++] = current;
+
+				if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+					clippedPolygon[clippedCount++] = interpolate(current, next, currentDistance / (currentDistance - nextDistance));
+			}
+
+			vertexCount = clippedCount;
+			std::copy_n(clippedPolygon, vertexCount, polygon);
+		}
+
+		// The clipped polygon is convex, so it is split into a fan
+		for (int vertexIndex{ 1 }; vertexIndex + 1 < vertexCount; vertexIndex++)
 		{
+			mesh.m_ClippedVertices.push_back(toScreen(polygon[0]));
+			mesh.m_ClippedVertices.push_back(toScreen(polygon[vertexIndex]));
+			mesh.m_ClippedVertices.push_back(toScreen(polygon[vertexIndex + 1]));
+			mesh.m_ClippedTriangleSources.push_back(triangleIndex);
+		}
+	}
+}
 
-			const Vector2 pixelCenter{ static_cast<float>(pixelX) + 0.5f,static_cast<float>(pixelY) + 0.5f };
-			const int pixelIndex = pixelX + pixelY * m_ScreenWidth;
+void Renderer::BinTriangles(const Mesh& mesh)
+{
+	const TransformedVertexBuffer& transformed{ mesh.m_VerticesTransformed };
+	const size_t triangleCount{ mesh.m_TriangleOrder.size() };
+
+	// Bins keep their memory between frames
+	for (std::vector<uint32_t>& bin : m_TileBins)
+		bin.clear();
 
+	const auto binTriangle = [this](std::vector<uint32_t>* chunkBins, uint32_t triangleIndex, const Vector2& v0, const Vector2& v1, const Vector2& v2)
+		{
+			// Back faces, degenerate triangles and triangles that miss every pixel center are dropped here
+			FixedTriangle triangle{};
+			if (!SetupTriangle(v0, v1, v2, triangle))
+				return;
 
-#ifdef DOUBLE_SIDED
-			if (normal.z > 0.0f)
+			for (int tileY{ triangle.minY / TILE_SIZE }; tileY <= (triangle.maxY - 1) / TILE_SIZE; tileY++)
 			{
-				signedAreaW0 = Vector2::Cross(pixelCenter - triangle.vertex1->pos.GetXY(), triangle.vertex2->pos.GetXY() - triangle.vertex1->pos.GetXY());
-				if (signedAreaW0 >= 0) continue;
-				signedAreaW1 = Vector2::Cross(pixelCenter - triangle.vertex2->pos.GetXY(), triangle.vertex0->pos.GetXY() - triangle.vertex2->pos.GetXY());
-				if (signedAreaW1 >= 0) continue;
-				signedAreaW2 = Vector2::Cross(pixelCenter - triangle.vertex0->pos.GetXY(), triangle.vertex1->pos.GetXY() - triangle.vertex0->pos.GetXY());
-				if (signedAreaW2 >= 0) continue;
+				for (int tileX{ triangle.minX / TILE_SIZE }; tileX <= (triangle.maxX - 1) / TILE_SIZE; tileX++)
+					chunkBins[tileX + tileY * m_TileCountX].push_back(triangleIndex);
 			}
-			else
+		};
+
+	// Every chunk bins one continuous part of the triangle order
+	std::for_each(std::execution::par, m_BinChunks.begin(), m_BinChunks.end(), [&](uint32_t chunk)
+		{
+			const size_t begin{ triangleCount * chunk / m_BinChunks.size() };
+			const size_t end{ triangleCount * (chunk + 1) / m_BinChunks.size() };
+
+			std::vector<uint32_t>* chunkBins{ &m_TileBins[chunk * m_Tiles.size()] };
+
+			for (size_t orderIndex{ begin }; orderIndex < end; orderIndex++)
 			{
-				signedAreaW0 = Vector2::Cross(triangle.vertex2->pos.GetXY() - triangle.vertex1->pos.GetXY(), pixelCenter - triangle.vertex1->pos.GetXY());
-				if (signedAreaW0 >= 0) continue;
-				signedAreaW1 = Vector2::Cross(triangle.vertex0->pos.GetXY() - triangle.vertex2->pos.GetXY(), pixelCenter - triangle.vertex2->pos.GetXY());
-				if (signedAreaW1 >= 0) continue;
-				signedAreaW2 = Vector2::Cross(triangle.vertex1->pos.GetXY() - triangle.vertex0->pos.GetXY(), pixelCenter - triangle.vertex0->pos.GetXY());
-				if (signedAreaW2 >= 0) continue;
+				const uint32_t triangleIndex{ mesh.m_TriangleOrder[orderIndex] };
+				const uint32_t index0{ mesh.m_Indices[triangleIndex * 3] };
+				const uint32_t index1{ mesh.m_Indices[triangleIndex * 3 + 1] };
+				const uint32_t index2{ mesh.m_Indices[triangleIndex * 3 + 2] };
+
+				// Triangles outside of a plane are rejected, the ones that need clipping were replaced by clipped triangles
+				const uint32_t outcode0{ transformed.outcodes[index0] };
+				const uint32_t outcode1{ transformed.outcodes[index1] };
+				const uint32_t outcode2{ transformed.outcodes[index2] };
+
+				if ((outcode0 & outcode1 & outcode2) != 0 or ((outcode0 | outcode1 | outcode2) & CLIP_NEEDS_CLIPPING) != 0)
+					continue;
+
+				binTriangle(chunkBins, triangleIndex,
+					{ transformed.positionX[index0], transformed.positionY[index0] },
+					{ transformed.positionX[index1], transformed.positionY[index1] },
+					{ transformed.positionX[index2], transformed.positionY[index2] });
 			}
-#else
-			signedAreaW0 = Vector2::Cross(pixelCenter - triangle.vertex1->pos.GetXY(), triangle.vertex2->pos.GetXY() - triangle.vertex1->pos.GetXY());
-			if (signedAreaW0 >= 0) continue;
-			signedAreaW1 = Vector2::Cross(pixelCenter - triangle.vertex2->pos.GetXY(), triangle.vertex0->pos.GetXY() - triangle.vertex2->pos.GetXY());
-			if (signedAreaW1 >= 0) continue;
-			signedAreaW2 = Vector2::Cross(pixelCenter - triangle.vertex0->pos.GetXY(), triangle.vertex1->pos.GetXY() - triangle.vertex0->pos.GetXY());
-			if (signedAreaW2 >= 0) continue;
+		});
+
+	// There are few clipped triangles, they go after everything else in the last chunk
+	std::vector<uint32_t>* lastChunkBins{ &m_TileBins[(m_BinChunks.size() - 1) * m_Tiles.size()] };
+	for (uint32_t clippedIndex{}; clippedIndex < mesh.m_ClippedTriangleSources.size(); clippedIndex++)
+	{
+		const VertexTransformed* vertices{ &mesh.m_ClippedVertices[clippedIndex * 3] };
+		binTriangle(lastChunkBins, mesh.GetTriangleCount() + clippedIndex, vertices[0].pos.GetXY(), vertices[1].pos.GetXY(), vertices[2].pos.GetXY());
+	}
+}
+
+bool Renderer::SetupTriangle(const Vector2& v0, const Vector2& v1, const Vector2& v2, FixedTriangle& triangle) const
+{
+	// Clipping keeps triangles within the guard band, this only catches screens too large for it
+	constexpr float maxCoordinate{ static_cast<float>(MAX_FIXED_COORDINATE) / SUBPIXEL_STEPS };
+	for (const Vector2* vertex : { &v0, &v1, &v2 })
+	{
+		if (!(std::abs(vertex->x) < maxCoordinate and std::abs(vertex->y) < maxCoordinate))
+			return false;
+	}
+
+	const Vector2* vertices[3]{ &v0, &v1, &v2 };
+	for (int vertexIndex{}; vertexIndex < 3; vertexIndex++)
+	{
+		triangle.x[vertexIndex] = std::llround(vertices[vertexIndex]->x * SUBPIXEL_STEPS);
+		triangle.y[vertexIndex] = std::llround(vertices[vertexIndex]->y * SUBPIXEL_STEPS);
+	}
+
+	// Same as the z of the cross product of the edges, but exact
+	triangle.doubleArea =
+		(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+		(triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+
+	if (triangle.doubleArea == 0)
+		return false;
+
+#ifndef DOUBLE_SIDED
+	if (triangle.doubleArea < 0)
+		return false;
 #endif
 
-			// Get total area before
-			const float totalArea = signedAreaW0 + signedAreaW1 + signedAreaW2;
-			const Vector3 weights
+	// Only pixels whose center lies within the bounds can be covered
+	constexpr int64_t halfPixel{ SUBPIXEL_STEPS / 2 };
+	const int64_t minX{ std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2])) };
+	const int64_t maxX{ std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2])) };
+	const int64_t minY{ std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2])) };
+	const int64_t maxY{ std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2])) };
+
+	triangle.minX = static_cast<int>(std::clamp<int64_t>((minX - halfPixel + SUBPIXEL_STEPS - 1) >> SUBPIXEL_BITS, 0, m_ScreenWidth));
+	triangle.maxX = static_cast<int>(std::clamp<int64_t>(((maxX - halfPixel) >> SUBPIXEL_BITS) + 1, 0, m_ScreenWidth));
+	triangle.minY = static_cast<int>(std::clamp<int64_t>((minY - halfPixel + SUBPIXEL_STEPS - 1) >> SUBPIXEL_BITS, 0, m_ScreenHeight));
+	triangle.maxY = static_cast<int>(std::clamp<int64_t>(((maxY - halfPixel) >> SUBPIXEL_BITS) + 1, 0, m_ScreenHeight));
+
+	// Sub pixel triangles that fall between pixel centers
+	return triangle.minX < triangle.maxX and triangle.minY < triangle.maxY;
+}
+
+VertexTransformed Renderer::GatherVertex(const Mesh& mesh, uint32_t vertexIndex)
+{
+	const TransformedVertexBuffer& transformed{ mesh.m_VerticesTransformed };
+
+	VertexTransformed vertex{};
+	vertex.pos = { transformed.positionX[vertexIndex], transformed.positionY[vertexIndex], transformed.positionZ[vertexIndex], transformed.positionW[vertexIndex] };
+	vertex.worldPos = { transformed.worldX[vertexIndex], transformed.worldY[vertexIndex], transformed.worldZ[vertexIndex] };
+	vertex.uv = mesh.m_Vertices.uv[vertexIndex];
+	vertex.normal = { transformed.normalX[vertexIndex], transformed.normalY[vertexIndex], transformed.normalZ[vertexIndex] };
+	vertex.tangent = { transformed.tangentX[vertexIndex], transformed.tangentY[vertexIndex], transformed.tangentZ[vertexIndex] };
+	vertex.viewDirection = { transformed.viewDirectionX[vertexIndex], transformed.viewDirectionY[vertexIndex], transformed.viewDirectionZ[vertexIndex] };
+	vertex.color = Mesh::GetVertexColor(vertexIndex);
+	return vertex;
+}
+
+void Renderer::GatherTriangle(const Mesh& mesh, uint32_t triangleIndex, VertexTransformed& vertex0, VertexTransformed& vertex1, VertexTransformed& vertex2)
+{
+	const uint32_t triangleCount{ mesh.GetTriangleCount() };
+
+	// Clipped triangles already have their vertices gathered
+	if (triangleIndex >= triangleCount)
+	{
+		const VertexTransformed* vertices{ &mesh.m_ClippedVertices[(triangleIndex - triangleCount) * 3] };
+		vertex0 = vertices[0];
+		vertex1 = vertices[1];
+		vertex2 = vertices[2];
+		return;
+	}
+
+	vertex0 = GatherVertex(mesh, mesh.m_Indices[triangleIndex * 3]);
+	vertex1 = GatherVertex(mesh, mesh.m_Indices[triangleIndex * 3 + 1]);
+	vertex2 = GatherVertex(mesh, mesh.m_Indices[triangleIndex * 3 + 2]);
+}
+
+uint32_t Renderer::GetSourceTriangle(const Mesh& mesh, uint32_t triangleIndex)
+{
+	const uint32_t triangleCount{ mesh.GetTriangleCount() };
+	return triangleIndex < triangleCount ? triangleIndex : mesh.m_ClippedTriangleSources[triangleIndex - triangleCount];
+}
+
+const Material* Renderer::GetTriangleMaterial(const Mesh& mesh, uint32_t triangleIndex) const
+{
+	if (!mesh.m_MaterialPtrs.empty())
+	{
+		if (const Material* materialAtIndex = mesh.m_MaterialPtrs[mesh.m_TriangleMaterialIndices[triangleIndex]])
+			return materialAtIndex;
+	}
+
+	return defaultMaterial;
+}
+
+void Renderer::CreateEdges(const FixedTriangle& triangle, EdgeFunction edges[3])
+{
+	// Back faces have their edges the other way around
+	const int64_t edgeSign{ triangle.doubleArea > 0 ? 1 : -1 };
+
+	const auto createEdge = [&](int start, int end)
+	{
+		const int64_t stepX{ edgeSign * (triangle.y[start] - triangle.y[end]) };
+		const int64_t stepY{ edgeSign * (triangle.x[end] - triangle.x[start]) };
+
+		// The inside is to the right of a left edge, and below a flat top edge
+		const bool isTopLeft{ stepX > 0 or (stepX == 0 and stepY > 0) };
+
+		return EdgeFunction{ triangle.x[start], triangle.y[start], stepX, stepY, isTopLeft ? 1 : 0 };
+	};
+
+	edges[0] = createEdge(1, 2);
+	edges[1] = createEdge(2, 0);
+	edges[2] = createEdge(0, 1);
+}
+
+void Renderer::RasterizeTriangle(const Mesh& mesh, uint32_t meshIndex, uint32_t triangleIndex, const Tile& tile) const
+{
+	// Gather the three vertices from the transformed arrays
+	VertexTransformed vertex0{};
+	VertexTransformed vertex1{};
+	VertexTransformed vertex2{};
+	GatherTriangle(mesh, triangleIndex, vertex0, vertex1, vertex2);
+
+	// Clipped triangles use the material of the triangle they were cut from
+	const uint32_t sourceTriangle{ GetSourceTriangle(mesh, triangleIndex) };
+	const int materialIndex{ mesh.m_TriangleMaterialIndices[sourceTriangle] };
+	const Material* material{ GetTriangleMaterial(mesh, sourceTriangle) };
+	const ShadePixelFunction shadePixel{ GetShadePixelFunction(material) };
+	const uint32_t visibilityId{ meshIndex << VISIBILITY_TRIANGLE_BITS | triangleIndex };
+
+	FixedTriangle triangle{};
+	if (!SetupTriangle(vertex0.pos.GetXY(), vertex1.pos.GetXY(), vertex2.pos.GetXY(), triangle))
+		return;
+
+	// Clamping is done so that the triangle is not rendered outside of the tile
+	const int minX = std::ranges::clamp(triangle.minX, tile.minX, tile.maxX);
+	const int maxX = std::ranges::clamp(triangle.maxX, tile.minX, tile.maxX);
+	const int minY = std::ranges::clamp(triangle.minY, tile.minY, tile.maxY);
+	const int maxY = std::ranges::clamp(triangle.maxY, tile.minY, tile.maxY);
+
+	// Depth is linear in screen space, so no pixel of the triangle is nearer than its nearest vertex
+	const float vertexDepth0{ 1.0f / vertex0.pos.z };
+	const float vertexDepth1{ 1.0f / vertex1.pos.z };
+	const float vertexDepth2{ 1.0f / vertex2.pos.z };
+	const float triangleMinDepth{ std::min(vertexDepth0, std::min(vertexDepth1, vertexDepth2)) };
+
+	if (triangleMinDepth - HIZ_TOLERANCE > m_pTileMaxDepth[tile.index])
+		return;
+
+	EdgeFunction edges[3];
+	CreateEdges(triangle, edges);
+
+	const float inverseDoubleArea{ 1.0f / static_cast<float>(std::abs(triangle.doubleArea)) };
+	const float vertexDepths[3]{ vertexDepth0, vertexDepth1, vertexDepth2 };
+
+	// Change of the weights per pixel, textures use it to pick their mip level
+	const Vector3 weightStepX
+	{
+		static_cast<float>(edges[0].stepX * SUBPIXEL_STEPS) * inverseDoubleArea,
+		static_cast<float>(edges[1].stepX * SUBPIXEL_STEPS) * inverseDoubleArea,
+		static_cast<float>(edges[2].stepX * SUBPIXEL_STEPS) * inverseDoubleArea
+	};
+	const Vector3 weightStepY
+	{
+		static_cast<float>(edges[0].stepY * SUBPIXEL_STEPS) * inverseDoubleArea,
+		static_cast<float>(edges[1].stepY * SUBPIXEL_STEPS) * inverseDoubleArea,
+		static_cast<float>(edges[2].stepY * SUBPIXEL_STEPS) * inverseDoubleArea
+	};
+
+	const __m128 zero{ _mm_setzero_ps() };
+	const __m128 one{ _mm_set1_ps(1.0f) };
+	const __m128i zeroInt{ _mm_setzero_si128() };
+	const __m128 laneOffsets{ _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f) };
+	const __m128i laneOffsetsInt{ _mm_setr_epi32(0, 1, 2, 3) };
+	const __m128 depth0{ _mm_set1_ps(vertex0.pos.z) };
+	const __m128 depth1{ _mm_set1_ps(vertex1.pos.z) };
+	const __m128 depth2{ _mm_set1_ps(vertex2.pos.z) };
+
+	// Coverage is tested with integer values, weights are interpolated as floats
+	int64_t pixelStepsX[3];
+	int64_t pixelStepsY[3];
+	__m128i laneSteps[3];
+	__m128i spanSteps[3];
+	__m128 laneStepsFloat[3];
+	__m128 spanStepsFloat[3];
+
+	// Change of the depth per pixel, used to find the nearest depth in a block
+	float depthStepX{};
+	float depthStepY{};
+
+	for (int edgeIndex{}; edgeIndex < 3; edgeIndex++)
+	{
+		pixelStepsX[edgeIndex] = edges[edgeIndex].stepX * SUBPIXEL_STEPS;
+		pixelStepsY[edgeIndex] = edges[edgeIndex].stepY * SUBPIXEL_STEPS;
+
+		depthStepX += static_cast<float>(pixelStepsX[edgeIndex]) * inverseDoubleArea * vertexDepths[edgeIndex];
+		depthStepY += static_cast<float>(pixelStepsY[edgeIndex]) * inverseDoubleArea * vertexDepths[edgeIndex];
+
+		laneSteps[edgeIndex] = _mm_setr_epi32(0, static_cast<int>(pixelStepsX[edgeIndex]), static_cast<int>(pixelStepsX[edgeIndex] * 2), static_cast<int>(pixelStepsX[edgeIndex] * 3));
+		spanSteps[edgeIndex] = _mm_set1_epi32(static_cast<int>(pixelStepsX[edgeIndex] * RASTER_SPAN_SIZE));
+		laneStepsFloat[edgeIndex] = _mm_mul_ps(_mm_set1_ps(static_cast<float>(pixelStepsX[edgeIndex])), laneOffsets);
+		spanStepsFloat[edgeIndex] = _mm_set1_ps(static_cast<float>(pixelStepsX[edgeIndex] * RASTER_SPAN_SIZE));
+	}
+
+	// Walk the bounding box in blocks, whole blocks outside of an edge are skipped
+	// and edges a block is fully inside of don't need their pixels tested
+	constexpr int64_t blockReach{ RASTER_BLOCK_SIZE - 1 };
+	bool hasWrittenDepth{ false };
+
+	for (int blockY{ minY / RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE }; blockY < maxY; blockY += RASTER_BLOCK_SIZE)
+	{
+		for (int blockX{ minX / RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE }; blockX < maxX; blockX += RASTER_BLOCK_SIZE)
+		{
+			// Values at the center of the top left pixel, the corners are found from the steps
+			int64_t blockValues[3];
+			bool isEdgePartial[3];
+			bool isOutside{ false };
+
+			for (int edgeIndex{}; edgeIndex < 3; edgeIndex++)
 			{
-				signedAreaW0 / totalArea,
-				signedAreaW1 / totalArea,
-				signedAreaW2 / totalArea,
-			};
+				blockValues[edgeIndex] = edges[edgeIndex].Evaluate(blockX, blockY);
+
+				const int64_t biasedValue{ blockValues[edgeIndex] + edges[edgeIndex].bias };
+				const int64_t maxValue{ biasedValue + (std::max<int64_t>(pixelStepsX[edgeIndex], 0) + std::max<int64_t>(pixelStepsY[edgeIndex], 0)) * blockReach };
+				const int64_t minValue{ biasedValue + (std::min<int64_t>(pixelStepsX[edgeIndex], 0) + std::min<int64_t>(pixelStepsY[edgeIndex], 0)) * blockReach };
 
-			const float nonLinearDepth = (
-				weights.x / triangle.vertex0->pos.z +
-				weights.y / triangle.vertex1->pos.z +
-				weights.z / triangle.vertex2->pos.z);
+				isOutside |= maxValue <= 0;
+				isEdgePartial[edgeIndex] = minValue <= 0;
+			}
 
+			if (isOutside)
+				continue;
 
-			// Don't cull when showing depth buffer
-			if (m_RenderMode != DebugRenderMode::DepthBuffer)
-				if (nonLinearDepth < 0.0f or nonLinearDepth > 1.0f)
-					continue;
+			// Blocks where the triangle is behind everything that was drawn are skipped
+			const int depthBlockIndex{ blockX / RASTER_BLOCK_SIZE + blockY / RASTER_BLOCK_SIZE * m_DepthBlockCountX };
+
+			float blockDepth{};
+			for (int edgeIndex{}; edgeIndex < 3; edgeIndex++)
+				blockDepth += static_cast<float>(blockValues[edgeIndex]) * inverseDoubleArea * vertexDepths[edgeIndex];
 
+			const float blockMinDepth{ std::max(triangleMinDepth, blockDepth + (std::min(depthStepX, 0.0f) + std::min(depthStepY, 0.0f)) * blockReach) };
+			if (blockMinDepth - HIZ_TOLERANCE > m_pBlockMaxDepth[depthBlockIndex])
+				continue;
 
-			const Material* material = defaultMaterial;
+			bool isBlockWritten{ false };
 
-			if (!materialPtrs.empty())
+			const int blockMaxX{ std::min(blockX + RASTER_BLOCK_SIZE, maxX) };
+			const int blockMaxY{ std::min(blockY + RASTER_BLOCK_SIZE, maxY) };
+
+			for (int pixelY{ std::max(blockY, minY) }; pixelY < blockMaxY; pixelY++)
 			{
-				if(const Material* materialAtIndex = materialPtrs[triangle.vertex0->materialIndex])
-					material = materialAtIndex;
+				const int64_t rowOffset{ pixelY - blockY };
+
+				// Partial edges stay within 32 bits inside of a block
+				__m128i coverageValues[3];
+				__m128 edgeValues[3];
+				for (int edgeIndex{}; edgeIndex < 3; edgeIndex++)
+				{
+					const int64_t rowValue{ blockValues[edgeIndex] + pixelStepsY[edgeIndex] * rowOffset };
+					edgeValues[edgeIndex] = _mm_add_ps(_mm_set1_ps(static_cast<float>(rowValue)), laneStepsFloat[edgeIndex]);
+
+					if (isEdgePartial[edgeIndex])
+						coverageValues[edgeIndex] = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(rowValue + edges[edgeIndex].bias)), laneSteps[edgeIndex]);
+				}
+
+				for (int spanX{ blockX }; spanX < blockMaxX; spanX += RASTER_SPAN_SIZE)
+				{
+					const __m128 w0{ edgeValues[0] };
+					const __m128 w1{ edgeValues[1] };
+					const __m128 w2{ edgeValues[2] };
+
+					// Lanes outside of the bounding box or the tile are never written
+					const int firstX{ std::max(spanX, minX) };
+					__m128i coverage{ _mm_andnot_si128(
+						_mm_cmplt_epi32(laneOffsetsInt, _mm_set1_epi32(firstX - spanX)),
+						_mm_cmplt_epi32(laneOffsetsInt, _mm_set1_epi32(blockMaxX - spanX))) };
+
+					for (int edgeIndex{}; edgeIndex < 3; edgeIndex++)
+					{
+						edgeValues[edgeIndex] = _mm_add_ps(edgeValues[edgeIndex], spanStepsFloat[edgeIndex]);
+
+						if (!isEdgePartial[edgeIndex])
+							continue;
+
+						coverage = _mm_and_si128(coverage, _mm_cmpgt_epi32(coverageValues[edgeIndex], zeroInt));
+						coverageValues[edgeIndex] = _mm_add_epi32(coverageValues[edgeIndex], spanSteps[edgeIndex]);
+					}
+
+					if (_mm_movemask_epi8(coverage) == 0)
+						continue;
+
+					const __m128 inverseArea{ _mm_set1_ps(inverseDoubleArea) };
+					const __m128 weight0{ _mm_mul_ps(w0, inverseArea) };
+					const __m128 weight1{ _mm_mul_ps(w1, inverseArea) };
+					const __m128 weight2{ _mm_mul_ps(w2, inverseArea) };
+
+					const __m128 nonLinearDepth{ _mm_add_ps(_mm_add_ps(_mm_div_ps(weight0, depth0), _mm_div_ps(weight1, depth1)), _mm_div_ps(weight2, depth2)) };
+
+					__m128 coverageMask{ _mm_castsi128_ps(coverage) };
+
+					// Don't cull when showing depth buffer
+					if (m_RenderMode != DebugRenderMode::DepthBuffer)
+						coverageMask = _mm_and_ps(coverageMask, _mm_and_ps(_mm_cmpnlt_ps(nonLinearDepth, zero), _mm_cmpngt_ps(nonLinearDepth, one)));
+
+					// Depth test the whole span before anything is sampled, the last span of a row can't be loaded past the screen
+					const int spanIndex{ spanX + pixelY * m_ScreenWidth };
+					if (spanX + RASTER_SPAN_SIZE <= m_ScreenWidth)
+						coverageMask = _mm_and_ps(coverageMask, _mm_cmpngt_ps(nonLinearDepth, _mm_loadu_ps(m_pDepthBufferPixels + spanIndex)));
+
+					int coveredLanes{ _mm_movemask_ps(coverageMask) };
+					if (coveredLanes == 0)
+						continue;
+
+					alignas(16) float laneWeights0[4];
+					alignas(16) float laneWeights1[4];
+					alignas(16) float laneWeights2[4];
+					alignas(16) float laneDepths[4];
+					_mm_store_ps(laneWeights0, weight0);
+					_mm_store_ps(laneWeights1, weight1);
+					_mm_store_ps(laneWeights2, weight2);
+					_mm_store_ps(laneDepths, nonLinearDepth);
+
+					while (coveredLanes != 0)
+					{
+						const int lane{ std::countr_zero(static_cast<uint32_t>(coveredLanes)) };
+						coveredLanes &= coveredLanes - 1;
+
+						isBlockWritten |= ShadeCoveredPixel(vertex0, vertex1, vertex2, material, materialIndex, shadePixel, visibilityId,
+							spanIndex + lane,
+							Vector3{ laneWeights0[lane], laneWeights1[lane], laneWeights2[lane] },
+							weightStepX, weightStepY,
+							laneDepths[lane]);
+					}
+				}
 			}
 
+			if (isBlockWritten)
+			{
+				UpdateBlockMaxDepth(blockX, blockY);
+				hasWrittenDepth = true;
+			}
+		}
+	}
+
+	if (hasWrittenDepth)
+		UpdateTileMaxDepth(tile);
+}
+
+void Renderer::UpdateBlockMaxDepth(int blockX, int blockY) const
+{
+	const int maxX{ std::min(blockX + RASTER_BLOCK_SIZE, m_ScreenWidth) };
+	const int maxY{ std::min(blockY + RASTER_BLOCK_SIZE, m_ScreenHeight) };
+
+	float maxDepth{ std::numeric_limits<float>::lowest() };
+	for (int pixelY{ blockY }; pixelY < maxY; pixelY++)
+	{
+		const float* pRow{ m_pDepthBufferPixels + pixelY * m_ScreenWidth };
+		for (int pixelX{ blockX }; pixelX < maxX; pixelX++)
+			maxDepth = std::max(maxDepth, pRow[pixelX]);
+	}
+
+	m_pBlockMaxDepth[blockX / RASTER_BLOCK_SIZE + blockY / RASTER_BLOCK_SIZE * m_DepthBlockCountX] = maxDepth;
+}
+
+void Renderer::UpdateTileMaxDepth(const Tile& tile) const
+{
+	float maxDepth{ std::numeric_limits<float>::lowest() };
+	for (int blockY{ tile.minY / RASTER_BLOCK_SIZE }; blockY <= (tile.maxY - 1) / RASTER_BLOCK_SIZE; blockY++)
+	{
+		for (int blockX{ tile.minX / RASTER_BLOCK_SIZE }; blockX <= (tile.maxX - 1) / RASTER_BLOCK_SIZE; blockX++)
+			maxDepth = std::max(maxDepth, m_pBlockMaxDepth[blockX + blockY * m_DepthBlockCountX]);
+	}
+
+	m_pTileMaxDepth[tile.index] = maxDepth;
+}
+
+bool Renderer::ShadeCoveredPixel(const VertexTransformed& vertex0, const VertexTransformed& vertex1, const VertexTransformed& vertex2,
+	const Material* material, int materialIndex, ShadePixelFunction shadePixel, uint32_t visibilityId, int pixelIndex,
+	const Vector3& weights, const Vector3& weightStepX, const Vector3& weightStepY, float nonLinearDepth) const
+{
+	// Depth check, done before the opacity is sampled
+	if (nonLinearDepth > m_pDepthBufferPixels[pixelIndex]) return false;
+
+	// The surface map is sampled once for the cutout, and handed to the shading when it happens right away
+	ColorRGB sampledSurface{};
+	const ColorRGB* pSampledSurface{};
 
 #ifdef RENDER_OPACITY_CUTOUT
 
-			if (material->opacity)
-			{
-				const float linearPixelDepth = 1.0f / (
-					weights.x / triangle.vertex0->pos.w +
-					weights.y / triangle.vertex1->pos.w +
-					weights.z / triangle.vertex2->pos.w);
+	if (material->hasOpacity)
+	{
+		const float linearPixelDepth = 1.0f / (
+			weights.x / vertex0.pos.w +
+			weights.y / vertex1.pos.w +
+			weights.z / vertex2.pos.w);
 
 
-				const Vector2 uv = linearPixelDepth * (
-					triangle.vertex0->uv / triangle.vertex0->pos.w * weights.x +
-					triangle.vertex1->uv / triangle.vertex1->pos.w * weights.y +
-					triangle.vertex2->uv / triangle.vertex2->pos.w * weights.z);
+		const Vector2 uv = linearPixelDepth * (
+			vertex0.uv / vertex0.pos.w * weights.x +
+			vertex1.uv / vertex1.pos.w * weights.y +
+			vertex2.uv / vertex2.pos.w * weights.z);
 
 
-				ColorRGB opacityMask = material->opacity->Sample(uv);
-				const float alpha = std::ranges::clamp(opacityMask.r, 0.0f, 1.0f);
+		Vector2 uvDerivativeX{};
+		Vector2 uvDerivativeY{};
+		GetUVDerivatives(vertex0, vertex1, vertex2, weightStepX, weightStepY, linearPixelDepth, uv, uvDerivativeX, uvDerivativeY);
 
-				if (alpha < 0.75f)
-					continue;
-			}
+		sampledSurface = material->surface->Sample(uv, uvDerivativeX, uvDerivativeY);
+		pSampledSurface = &sampledSurface;
+		const float alpha = std::ranges::clamp(sampledSurface.b, 0.0f, 1.0f);
+
+		if (alpha < 0.75f)
+			return false;
+	}
 #endif
 
+	m_pDepthBufferPixels[pixelIndex] = nonLinearDepth;
 
-			// Depth check
-			if (nonLinearDepth > m_pDepthBufferPixels[pixelIndex]) continue;
-			m_pDepthBufferPixels[pixelIndex] = nonLinearDepth;
-
-
-			const float linearPixelDepth = 1.0f / (
-				weights.x / triangle.vertex0->pos.w +
-				weights.y / triangle.vertex1->pos.w +
-				weights.z / triangle.vertex2->pos.w);
-
-			const Vector2 interpUV = linearPixelDepth * (
-				triangle.vertex0->uv / triangle.vertex0->pos.w * weights.x +
-				triangle.vertex1->uv / triangle.vertex1->pos.w * weights.y +
-				triangle.vertex2->uv / triangle.vertex2->pos.w * weights.z);
-
-			const Vector3 interpNormal = linearPixelDepth * (
-				triangle.vertex0->normal / triangle.vertex0->pos.w * weights.x +
-				triangle.vertex1->normal / triangle.vertex1->pos.w * weights.y +
-				triangle.vertex2->normal / triangle.vertex2->pos.w * weights.z);
-
-			const Vector3 interpTangent = linearPixelDepth * (
-				triangle.vertex0->tangent / triangle.vertex0->pos.w * weights.x +
-				triangle.vertex1->tangent / triangle.vertex1->pos.w * weights.y +
-				triangle.vertex2->tangent / triangle.vertex2->pos.w * weights.z);
-
-			const Vector3 interpViewDirection = linearPixelDepth * (
-				triangle.vertex0->viewDirection / triangle.vertex0->pos.w * weights.x +
-				triangle.vertex1->viewDirection / triangle.vertex1->pos.w * weights.y +
-				triangle.vertex2->viewDirection / triangle.vertex2->pos.w * weights.z);
-
-			const Vector3 interpPixelPosition = linearPixelDepth * (
-				triangle.vertex0->worldPos / triangle.vertex0->pos.w * weights.x +
-				triangle.vertex1->worldPos / triangle.vertex1->pos.w * weights.y +
-				triangle.vertex2->worldPos / triangle.vertex2->pos.w * weights.z);
-
-			const ColorRGB interpVertexColor = 
-				triangle.vertex0->color* weights.x +
-				triangle.vertex1->color * weights.y +
-				triangle.vertex2->color * weights.z;
-
-			// Will be called inline to avoid passing all parameters
-			ShadePixel
-			(
-				material,
-				triangle.vertex0->materialIndex,
-				pixelIndex,
-				interpVertexColor,
-				interpUV,
-				interpNormal,
-				interpTangent,
-				interpViewDirection,
-				interpPixelPosition,
-				nonLinearDepth
-			);
-		}
-#ifdef MULTI_THREAD_PIXELS
-		});
-#else
+	// Shading waits until every triangle is drawn
+	if (m_IsShadingDeferred)
+	{
+		m_pVisibilityBuffer[pixelIndex] = visibilityId;
+		return true;
 	}
-#endif
 
+	ShadeFragment(vertex0, vertex1, vertex2, material, materialIndex, shadePixel, pixelIndex, weights, weightStepX, weightStepY, nonLinearDepth, pSampledSurface);
+	return true;
+}
+
+void Renderer::ShadeVisibilityBuffer() const
+{
+	// Pixels of a tile are next to each other in most of their triangles, so the last triangle is kept around
+	std::for_each(std::execution::par, m_Tiles.begin(), m_Tiles.end(), [this](const Tile& tile)
+		{
+			uint32_t cachedId{ INVALID_VISIBILITY_ID };
+			VertexTransformed vertex0{};
+			VertexTransformed vertex1{};
+			VertexTransformed vertex2{};
+			const Material* material{};
+			int materialIndex{};
+			ShadePixelFunction shadePixel{};
+			EdgeFunction edges[3]{};
+			float inverseDoubleArea{};
+			Vector3 weightStepX{};
+			Vector3 weightStepY{};
+
+			for (int pixelY{ tile.minY }; pixelY < tile.maxY; pixelY++)
+			{
+				for (int pixelX{ tile.minX }; pixelX < tile.maxX; pixelX++)
+				{
+					const int pixelIndex{ pixelX + pixelY * m_ScreenWidth };
+					const uint32_t visibilityId{ m_pVisibilityBuffer[pixelIndex] };
+
+					if (visibilityId == INVALID_VISIBILITY_ID)
+						continue;
+
+					if (visibilityId != cachedId)
+					{
+						cachedId = visibilityId;
+
+						const Mesh& mesh{ m_WorldMeshes[visibilityId >> VISIBILITY_TRIANGLE_BITS] };
+						const uint32_t triangleIndex{ visibilityId & VISIBILITY_TRIANGLE_MASK };
+
+						GatherTriangle(mesh, triangleIndex, vertex0, vertex1, vertex2);
+
+						const uint32_t sourceTriangle{ GetSourceTriangle(mesh, triangleIndex) };
+						materialIndex = mesh.m_TriangleMaterialIndices[sourceTriangle];
+						material = GetTriangleMaterial(mesh, sourceTriangle);
+						shadePixel = GetShadePixelFunction(material);
+
+						// Same setup as when the triangle was rasterized, it can't fail for a triangle that was drawn
+						FixedTriangle triangle{};
+						SetupTriangle(vertex0.pos.GetXY(), vertex1.pos.GetXY(), vertex2.pos.GetXY(), triangle);
+						CreateEdges(triangle, edges);
+						inverseDoubleArea = 1.0f / static_cast<float>(std::abs(triangle.doubleArea));
+
+						for (int edgeIndex{}; edgeIndex < 3; edgeIndex++)
+						{
+							weightStepX[edgeIndex] = static_cast<float>(edges[edgeIndex].stepX * SUBPIXEL_STEPS) * inverseDoubleArea;
+							weightStepY[edgeIndex] = static_cast<float>(edges[edgeIndex].stepY * SUBPIXEL_STEPS) * inverseDoubleArea;
+						}
+					}
+
+					const Vector3 weights
+					{
+						static_cast<float>(edges[0].Evaluate(pixelX, pixelY)) * inverseDoubleArea,
+						static_cast<float>(edges[1].Evaluate(pixelX, pixelY)) * inverseDoubleArea,
+						static_cast<float>(edges[2].Evaluate(pixelX, pixelY)) * inverseDoubleArea
+					};
+
+					ShadeFragment(vertex0, vertex1, vertex2, material, materialIndex, shadePixel, pixelIndex, weights, weightStepX, weightStepY, m_pDepthBufferPixels[pixelIndex]);
+				}
+			}
+		});
+}
+
+void Renderer::ShadeFragment(const VertexTransformed& vertex0, const VertexTransformed& vertex1, const VertexTransformed& vertex2,
+	const Material* material, int materialIndex, ShadePixelFunction shadePixel, int pixelIndex,
+	const Vector3& weights, const Vector3& weightStepX, const Vector3& weightStepY, float nonLinearDepth,
+	const ColorRGB* pSampledSurface) const
+{
+
+	const float linearPixelDepth = 1.0f / (
+		weights.x / vertex0.pos.w +
+		weights.y / vertex1.pos.w +
+		weights.z / vertex2.pos.w);
+
+	const Vector2 interpUV = linearPixelDepth * (
+		vertex0.uv / vertex0.pos.w * weights.x +
+		vertex1.uv / vertex1.pos.w * weights.y +
+		vertex2.uv / vertex2.pos.w * weights.z);
+
+	Vector2 uvDerivativeX{};
+	Vector2 uvDerivativeY{};
+	GetUVDerivatives(vertex0, vertex1, vertex2, weightStepX, weightStepY, linearPixelDepth, interpUV, uvDerivativeX, uvDerivativeY);
+
+	const Vector3 interpNormal = linearPixelDepth * (
+		vertex0.normal / vertex0.pos.w * weights.x +
+		vertex1.normal / vertex1.pos.w * weights.y +
+		vertex2.normal / vertex2.pos.w * weights.z);
+
+	const Vector3 interpTangent = linearPixelDepth * (
+		vertex0.tangent / vertex0.pos.w * weights.x +
+		vertex1.tangent / vertex1.pos.w * weights.y +
+		vertex2.tangent / vertex2.pos.w * weights.z);
+
+	const Vector3 interpViewDirection = linearPixelDepth * (
+		vertex0.viewDirection / vertex0.pos.w * weights.x +
+		vertex1.viewDirection / vertex1.pos.w * weights.y +
+		vertex2.viewDirection / vertex2.pos.w * weights.z);
+
+	const Vector3 interpPixelPosition = linearPixelDepth * (
+		vertex0.worldPos / vertex0.pos.w * weights.x +
+		vertex1.worldPos / vertex1.pos.w * weights.y +
+		vertex2.worldPos / vertex2.pos.w * weights.z);
+
+	const ColorRGB interpVertexColor = 
+		vertex0.color* weights.x +
+		vertex1.color * weights.y +
+		vertex2.color * weights.z;
+
+	// Picked once per triangle for the render mode and the textures of the material
+	(this->*shadePixel)
+	(
+		material,
+		materialIndex,
+		pixelIndex,
+		interpVertexColor,
+		interpUV,
+		uvDerivativeX,
+		uvDerivativeY,
+		interpNormal,
+		interpTangent,
+		interpViewDirection,
+		interpPixelPosition,
+		nonLinearDepth,
+		pSampledSurface
+	);
+}
+
+void Renderer::GetUVDerivatives(const VertexTransformed& vertex0, const VertexTransformed& vertex1, const VertexTransformed& vertex2,
+	const Vector3& weightStepX, const Vector3& weightStepY, float linearPixelDepth, const Vector2& uv,
+	Vector2& uvDerivativeX, Vector2& uvDerivativeY)
+{
+	// The uv is the interpolated uv / w divided by the interpolated 1 / w, this is the quotient rule on that
+	const auto getDerivative = [&](const Vector3& weightStep)
+	{
+		const float inverseDepthStep{ weightStep.x / vertex0.pos.w + weightStep.y / vertex1.pos.w + weightStep.z / vertex2.pos.w };
+		const Vector2 uvStep
+		{
+			vertex0.uv / vertex0.pos.w * weightStep.x +
+			vertex1.uv / vertex1.pos.w * weightStep.y +
+			vertex2.uv / vertex2.pos.w * weightStep.z
+		};
+
+		return (uvStep - uv * inverseDepthStep) * linearPixelDepth;
+	};
+
+	uvDerivativeX = getDerivative(weightStepX);
+	uvDerivativeY = getDerivative(weightStepY);
+}
+
+template <size_t... functionIndices>
+constexpr std::array<Renderer::ShadePixelFunction, sizeof...(functionIndices)> Renderer::CreateShadePixelFunctions(std::index_sequence<functionIndices...>)
+{
+	return { &Renderer::ShadePixel<static_cast<DebugRenderMode>(functionIndices / MATERIAL_FEATURE_COMBINATIONS), functionIndices % MATERIAL_FEATURE_COMBINATIONS>... };
+}
+
+Renderer::ShadePixelFunction Renderer::GetShadePixelFunction(const Material* material) const
+{
+	static constexpr auto shadePixelFunctions{ CreateShadePixelFunctions(std::make_index_sequence<static_cast<size_t>(DebugRenderMode::COUNT) * MATERIAL_FEATURE_COMBINATIONS>{}) };
+
+	uint32_t materialFeatures{};
+
+	if (material->diffuse)
+		materialFeatures |= MATERIAL_DIFFUSE;
+
+	if (material->normal && m_UseNormalMap)
+		materialFeatures |= MATERIAL_NORMAL;
+
+	if (material->surface)
+		materialFeatures |= MATERIAL_SURFACE;
+
+	if (material->hasOpacity)
+		materialFeatures |= MATERIAL_OPACITY;
+
+	return shadePixelFunctions[static_cast<size_t>(m_RenderMode) * MATERIAL_FEATURE_COMBINATIONS + materialFeatures];
 }
 
+template <DebugRenderMode renderMode, uint32_t materialFeatures>
 void Renderer::ShadePixel(const Material* material, int materialIndex, int pixelIndex, ColorRGB vertexColor, Vector2 uv,
-                          Vector3 normal, Vector3 tangent, Vector3 viewDirection, Vector3 pixelPosition, float nonLinearDepth) const
+                          Vector2 uvDerivativeX, Vector2 uvDerivativeY, Vector3 normal, Vector3 tangent, Vector3 viewDirection, Vector3 pixelPosition, float nonLinearDepth, const ColorRGB* pSampledSurface) const
 {
+	constexpr bool hasDiffuse{ (materialFeatures & MATERIAL_DIFFUSE) != 0 };
+	constexpr bool hasNormal{ (materialFeatures & MATERIAL_NORMAL) != 0 };
+	constexpr bool hasSurface{ (materialFeatures & MATERIAL_SURFACE) != 0 };
+	constexpr bool hasOpacity{ (materialFeatures & MATERIAL_OPACITY) != 0 };
 
-	// Create locals for sampling
+	// Create locals for sampling, textures that the mode doesn't show are not sampled
 	Vector3 sampledNormal{ normal };
 	float sampledSpecular{ m_SpecularKs }; 
 	float sampledPhongExponent{ m_PhongExponentExp };
 	ColorRGB sampledDiffuseColor{material->diffuseColor}; // cd
 	ColorRGB sampledOpacity{0,0,0};
 
+	constexpr bool usesLights{
+		renderMode == DebugRenderMode::ObservedArea or
+		renderMode == DebugRenderMode::DiffuseOA or
+		renderMode == DebugRenderMode::SpecularOA or
+		renderMode == DebugRenderMode::Combined or
+		renderMode == DebugRenderMode::LightRadiance };
 
-	if (material->opacity)
-		sampledOpacity = material->opacity->Sample(uv);
+	constexpr bool usesDiffuse{ renderMode == DebugRenderMode::Diffuse or renderMode == DebugRenderMode::DiffuseOA or renderMode == DebugRenderMode::Combined };
+	constexpr bool usesSurface{ renderMode == DebugRenderMode::SpecularOA or renderMode == DebugRenderMode::Combined or renderMode == DebugRenderMode::Opacity };
+	constexpr bool usesNormal{ usesLights and renderMode != DebugRenderMode::LightRadiance };
 
-	if (material->specular)
-		sampledSpecular *= material->specular->Sample(uv).r; // NOTE Only using R
+	// One fetch for specular, gloss and opacity, unless the cutout test already did it
+	if constexpr (hasSurface and usesSurface)
+	{
+		const ColorRGB sampledSurface{ pSampledSurface ? *pSampledSurface : material->surface->Sample(uv, uvDerivativeX, uvDerivativeY) };
+		sampledSpecular *= sampledSurface.r;
+		sampledPhongExponent *= sampledSurface.g;
 
-	if (material->gloss)
-		sampledPhongExponent *= material->gloss->Sample(uv).r; // NOTE Only using R
+		if constexpr (hasOpacity)
+			sampledOpacity = ColorRGB{ sampledSurface.b, sampledSurface.b, sampledSurface.b };
+	}
 
-	if (material->diffuse)
-		sampledDiffuseColor = material->diffuse->Sample(uv);
+	if constexpr (hasDiffuse and usesDiffuse)
+		sampledDiffuseColor = material->diffuse->Sample(uv, uvDerivativeX, uvDerivativeY);
 
-	if (material->normal && m_UseNormalMap)
+	if constexpr (hasNormal and usesNormal)
 	{
 		const Matrix tangentSpaceAxis =
 		{
@@ -630,7 +1634,7 @@ void Renderer::ShadePixel(const Material* material, int materialIndex, int pixel
 			Vector3::Zero
 		};
 
-		const ColorRGB sampledNormalColor = material->normal->Sample(uv);
+		const ColorRGB sampledNormalColor = material->normal->Sample(uv, uvDerivativeX, uvDerivativeY);
 		const Vector3 sampledNormalMapped
 		{
 			2.0f * sampledNormalColor.r - 1.0f,
@@ -641,106 +1645,113 @@ void Renderer::ShadePixel(const Material* material, int materialIndex, int pixel
 		sampledNormal = tangentSpaceAxis.TransformPoint(sampledNormalMapped);
 	}
 
-	ColorRGB finalPixelColor{};
-	for (const Light& light : m_WorldLights)
-	{
-		Vector3 lightDirection{};
-
-		if (light.GetType() == LightType::Point)
-			lightDirection = (pixelPosition - light.GetOrigin()).Normalized();
-		else if (light.GetType() == LightType::Directional)
-			lightDirection = light.GetDirection();
-		
-
-
-		// Get lambert diffuse
-		ColorRGB lambertDiffuse = sampledDiffuseColor * m_DiffuseStrengthKd / PI;
-
-		// Get Cosine Law
-		const float observedArea = std::max(0.0f, Vector3::Dot(sampledNormal, -lightDirection));
-
-		// Get Specular Intensity
-		const Vector3 reflectedRay = Vector3::Reflect(lightDirection, sampledNormal);
-		const float cosAlpha{ std::max(Vector3::Dot(reflectedRay,-viewDirection),0.0f) };
-		const float specularIntensity{ sampledSpecular * std::powf(cosAlpha,sampledPhongExponent) };
+	// Get lambert diffuse
+	const ColorRGB lambertDiffuse = sampledDiffuseColor * m_DiffuseStrengthKd / PI;
 
+	ColorRGB finalPixelColor{};
 
-		switch (m_RenderMode)
+	// Modes that only show the surface don't look at the lights
+	if constexpr (renderMode == DebugRenderMode::Diffuse)
+	{
+		finalPixelColor = lambertDiffuse;
+	}
+	else if constexpr (renderMode == DebugRenderMode::UVColor)
+	{
+		finalPixelColor = m_pUVGridTexture->Sample(uv, uvDerivativeX, uvDerivativeY);
+	}
+	else if constexpr (renderMode == DebugRenderMode::Weights)
+	{
+		finalPixelColor = vertexColor;
+	}
+	else if constexpr (renderMode == DebugRenderMode::DepthBuffer)
+	{
+		if (nonLinearDepth < 0.0f)
 		{
-		case DebugRenderMode::Diffuse:
+			finalPixelColor = colors::Red;
+		}
+		else
 		{
-			finalPixelColor = lambertDiffuse;
+			if (nonLinearDepth > 1.0f)
+				finalPixelColor = colors::Blue;
+			else
+				finalPixelColor = colors::Green * nonLinearDepth;
+		}
+	}
+	else if constexpr (renderMode == DebugRenderMode::MaterialIndex)
+	{
+		srand(materialIndex);
 
-		} break;
-		case DebugRenderMode::ObservedArea:
-		{
-			finalPixelColor += colors::White * observedArea;
-		}break;
-		case DebugRenderMode::DiffuseOA:
-		{
-			finalPixelColor += lambertDiffuse * observedArea;
-		}break;
-		case DebugRenderMode::SpecularOA:
-		{
-			finalPixelColor += specularIntensity * colors::White;
-		}break;
-		case DebugRenderMode::Combined:
-		{
-			finalPixelColor += light.GetRadiance(pixelPosition) * ((specularIntensity * colors::White + lambertDiffuse) * observedArea) + m_AmbientColor;
-		} break;
-		case DebugRenderMode::UVColor:
-		{
-			finalPixelColor = m_MaterialPtrMap.at("uvGrid")->diffuse->Sample(uv);
-		} break;
-		case DebugRenderMode::Weights:
+		ColorRGB color
 		{
-			finalPixelColor = vertexColor;
+			(std::rand() * (materialIndex + 1) % 255) / 255.0f,
+			(std::rand() * (materialIndex + 1) % 255) / 255.0f,
+			(std::rand() * (materialIndex + 1) % 255) / 255.0f,
+		};
 
-		} break;
-		case DebugRenderMode::DepthBuffer:
+		finalPixelColor = color;
+	}
+	else if constexpr (renderMode == DebugRenderMode::Opacity)
+	{
+		finalPixelColor = sampledOpacity;
+	}
+	else if constexpr (usesLights)
+	{
+		// Ambient is added once, not once per light, so it doesn't change with the lights a tile keeps
+		if constexpr (renderMode == DebugRenderMode::Combined)
+			finalPixelColor = m_AmbientColor;
+
+		// Only the lights that can reach the tile of this pixel
+		const int tileX{ pixelIndex % m_ScreenWidth / TILE_SIZE };
+		const int tileY{ pixelIndex / m_ScreenWidth / TILE_SIZE };
+
+		for (uint32_t lightIndex : m_TileLights[tileX + tileY * m_TileCountX])
 		{
-			if (nonLinearDepth < 0.0f)
+			const Light& light{ m_WorldLights[lightIndex] };
+
+			if constexpr (renderMode == DebugRenderMode::LightRadiance)
 			{
-				finalPixelColor = colors::Red;
+				finalPixelColor += light.GetRadiance(pixelPosition);
 			}
 			else
 			{
-				if (nonLinearDepth > 1.0f)
-					finalPixelColor = colors::Blue;
+				Vector3 lightDirection{};
+
+				if (light.GetType() == LightType::Point)
+					lightDirection = (pixelPosition - light.GetOrigin()).Normalized();
+				else if (light.GetType() == LightType::Directional)
+					lightDirection = light.GetDirection();
+
+				// Get Cosine Law
+				const float observedArea = std::max(0.0f, Vector3::Dot(sampledNormal, -lightDirection));
+
+				if constexpr (renderMode == DebugRenderMode::ObservedArea)
+				{
+					finalPixelColor += colors::White * observedArea;
+				}
+				else if constexpr (renderMode == DebugRenderMode::DiffuseOA)
+				{
+					finalPixelColor += lambertDiffuse * observedArea;
+				}
 				else
-					finalPixelColor = colors::Green * nonLinearDepth;
+				{
+					// Get Specular Intensity
+					const Vector3 reflectedRay = Vector3::Reflect(lightDirection, sampledNormal);
+					const float cosAlpha{ std::max(Vector3::Dot(reflectedRay,-viewDirection),0.0f) };
+					const float specularIntensity{ sampledSpecular * std::powf(cosAlpha,sampledPhongExponent) };
+
+					if constexpr (renderMode == DebugRenderMode::SpecularOA)
+						finalPixelColor += specularIntensity * colors::White;
+					else
+						finalPixelColor += light.GetRadiance(pixelPosition) * ((specularIntensity * colors::White + lambertDiffuse) * observedArea);
+				}
 			}
-		}break;
-		case DebugRenderMode::MaterialIndex:
-		{
-			srand(materialIndex);
-
-			ColorRGB color
-			{
-				(std::rand() * (materialIndex + 1) % 255) / 255.0f,
-				(std::rand() * (materialIndex + 1) % 255) / 255.0f,
-				(std::rand() * (materialIndex + 1) % 255) / 255.0f,
-			};
-
-			finalPixelColor = color;
-		} break;
-		case DebugRenderMode::Opacity:
-		{
-			finalPixelColor = sampledOpacity;
-		} break;
-		case DebugRenderMode::LightRadiance:
-		{
-			finalPixelColor += light.GetRadiance(pixelPosition);
-		} break;
 		}
 	}
 
-	//Update Color in Buffer
-	finalPixelColor.MaxToOne();
-	m_BackBufferPixelsPtr[pixelIndex] = SDL_MapRGB(m_BackBufferPtr->format,
-		static_cast<uint8_t>(finalPixelColor.r * 255),
-		static_cast<uint8_t>(finalPixelColor.g * 255),
-		static_cast<uint8_t>(finalPixelColor.b * 255));
+	//Update Color in Buffer, clamping and packing happens when the frame is resolved
+	m_pColorBufferR[pixelIndex] = finalPixelColor.r;
+	m_pColorBufferG[pixelIndex] = finalPixelColor.g;
+	m_pColorBufferB[pixelIndex] = finalPixelColor.b;
 }
 
 
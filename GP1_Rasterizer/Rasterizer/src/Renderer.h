@@ -1,8 +1,11 @@
 #pragma once
+#include <array>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 #include <DataTypes.h>
+#include <PixelResolver.h>
 
 #include "Mesh.h"
 
@@ -70,20 +73,115 @@ namespace dae
 		void ToggleRotation();
 		void ToggleNormalMap();
 		void ToggleLinearDepth();
+		void ToggleToneMapping();
+		void ToggleGammaCorrection();
+		void ToggleVisibilityBuffer();
 		void SetRenderMode(DebugRenderMode mode);
 		void CycleRenderMode();
 
 		bool SaveBufferToImage() const;
 
+		// Clusters of the last frame
+		uint32_t GetDrawnClusterCount() const { return m_DrawnClusterCount; }
+		uint32_t GetCulledClusterCount() const { return m_CulledClusterCount; }
+		uint32_t GetBackFacingClusterCount() const { return m_BackFacingClusterCount; }
+
 	private:
 
+		// Pixels of the screen that are rasterized together, one thread owns a tile at a time
+		struct Tile
+		{
+			int index;
+			int minX;
+			int minY;
+			int maxX;
+			int maxY;
+		};
+
+		// Screen positions of a triangle in 28.4 fixed point, with the pixels it can cover
+		struct FixedTriangle
+		{
+			int64_t x[3];
+			int64_t y[3];
+			int64_t doubleArea;	// Positive for front faces
+			int minX;
+			int minY;
+			int maxX;
+			int maxY;
+		};
+
+		// ShadePixel is compiled for every render mode and every combination of these textures, one is picked per triangle
+		static constexpr uint32_t MATERIAL_DIFFUSE{ 1 << 0 };
+		static constexpr uint32_t MATERIAL_NORMAL{ 1 << 1 };	// Only when normal mapping is on
+		static constexpr uint32_t MATERIAL_SURFACE{ 1 << 2 };
+		static constexpr uint32_t MATERIAL_OPACITY{ 1 << 3 };
+		static constexpr uint32_t MATERIAL_FEATURE_COMBINATIONS{ 1 << 4 };
+
+		using ShadePixelFunction = void (Renderer::*)(const Material* material, int materialIndex, int pixelIndex, ColorRGB vertexColor,
+			Vector2 uv, Vector2 uvDerivativeX, Vector2 uvDerivativeY, Vector3 normal, Vector3 tangent, Vector3 viewDirection,
+			Vector3 pixelPosition, float nonLinearDepth, const ColorRGB* pSampledSurface) const;
+
+		// Vertex of a polygon that is being clipped, the attributes are interpolated along with the clip space position
+		struct ClipVertex
+		{
+			Vector4 clipPosition;
+			VertexTransformed vertex;
+		};
+
+		// Edge functions are positive inside the triangle, in 28.4 they are exact
+		// Edge i is opposite to vertex i, so its value divided by the total is the weight of that vertex
+		struct EdgeFunction
+		{
+			int64_t startX;
+			int64_t startY;
+			int64_t stepX;	// Per sub pixel
+			int64_t stepY;
+			int64_t bias;	// Pixels exactly on a top or left edge are covered, on other edges they are not
+
+			int64_t Evaluate(int pixelX, int pixelY) const
+			{
+				constexpr int64_t halfPixel{ SUBPIXEL_STEPS / 2 };
+				return (pixelX * int64_t{ SUBPIXEL_STEPS } + halfPixel - startX) * stepX + (pixelY * int64_t{ SUBPIXEL_STEPS } + halfPixel - startY) * stepY;
+			}
+		};
+
+		bool CanUseVisibilityBuffer() const;
+		void CullClusters(Mesh& mesh);
+		void CullLights(bool useTileDepth);
+		static uint32_t GetFrustumOutcode(const Vector4& clipPosition);
 		void TransformMesh(Mesh& mesh) const;
+		void TransformVertexBlock(Mesh& mesh, const Matrix& worldToViewProjectionMatrix, const VertexRange& block) const;
 
-		inline void RasterizeMesh(Mesh& mesh) const;
-		inline void RasterizeTriangle(const Triangle& triangle, const std::vector<Material*>& materialPtrs) const;
-		inline void ShadePixel(const Material* material, int materialIndex, int pixelIndex, ColorRGB vertexColor,
-		                       Vector2 uv, Vector3 normal, Vector3 tangent, Vector3 viewDirection,
-		                       Vector3 pixelPosition, float nonLinearDepth) const;
+		inline void RasterizeMesh(Mesh& mesh, uint32_t meshIndex);
+		void ClipTriangles(Mesh& mesh) const;
+		void BinTriangles(const Mesh& mesh);
+		bool SetupTriangle(const Vector2& v0, const Vector2& v1, const Vector2& v2, FixedTriangle& triangle) const;
+		static void CreateEdges(const FixedTriangle& triangle, EdgeFunction edges[3]);
+		static VertexTransformed GatherVertex(const Mesh& mesh, uint32_t vertexIndex);
+		static void GatherTriangle(const Mesh& mesh, uint32_t triangleIndex, VertexTransformed& vertex0, VertexTransformed& vertex1, VertexTransformed& vertex2);
+		static uint32_t GetSourceTriangle(const Mesh& mesh, uint32_t triangleIndex);
+		const Material* GetTriangleMaterial(const Mesh& mesh, uint32_t triangleIndex) const;
+		inline void RasterizeTriangle(const Mesh& mesh, uint32_t meshIndex, uint32_t triangleIndex, const Tile& tile) const;
+		inline bool ShadeCoveredPixel(const VertexTransformed& vertex0, const VertexTransformed& vertex1, const VertexTransformed& vertex2,
+		                              const Material* material, int materialIndex, ShadePixelFunction shadePixel, uint32_t visibilityId, int pixelIndex,
+		                              const Vector3& weights, const Vector3& weightStepX, const Vector3& weightStepY, float nonLinearDepth) const;
+		void ShadeVisibilityBuffer() const;
+		inline void ShadeFragment(const VertexTransformed& vertex0, const VertexTransformed& vertex1, const VertexTransformed& vertex2,
+		                          const Material* material, int materialIndex, ShadePixelFunction shadePixel, int pixelIndex,
+		                          const Vector3& weights, const Vector3& weightStepX, const Vector3& weightStepY, float nonLinearDepth,
+		                          const ColorRGB* pSampledSurface = nullptr) const;
+		static void GetUVDerivatives(const VertexTransformed& vertex0, const VertexTransformed& vertex1, const VertexTransformed& vertex2,
+		                             const Vector3& weightStepX, const Vector3& weightStepY, float linearPixelDepth, const Vector2& uv,
+		                             Vector2& uvDerivativeX, Vector2& uvDerivativeY);
+		void UpdateBlockMaxDepth(int blockX, int blockY) const;
+		void UpdateTileMaxDepth(const Tile& tile) const;
+		ShadePixelFunction GetShadePixelFunction(const Material* material) const;
+		template <size_t... functionIndices>
+		static constexpr std::array<ShadePixelFunction, sizeof...(functionIndices)> CreateShadePixelFunctions(std::index_sequence<functionIndices...>);
+		template <DebugRenderMode renderMode, uint32_t materialFeatures>
+		void ShadePixel(const Material* material, int materialIndex, int pixelIndex, ColorRGB vertexColor,
+		                Vector2 uv, Vector2 uvDerivativeX, Vector2 uvDerivativeY, Vector3 normal, Vector3 tangent, Vector3 viewDirection,
+		                Vector3 pixelPosition, float nonLinearDepth, const ColorRGB* pSampledSurface) const;
 
 		void InitializeSceneAssignment();
 		void InitializeSceneCar();
@@ -99,6 +197,28 @@ namespace dae
 		uint32_t* m_BackBufferPixelsPtr{};
 		float* m_pDepthBufferPixels{ nullptr };
 
+		// Mesh index in the top bits and triangle index in the bottom bits of the triangle drawn at every pixel
+		uint32_t* m_pVisibilityBuffer{ nullptr };
+		bool m_UseVisibilityBuffer{ true };
+		bool m_IsShadingDeferred{ false };	// Visibility buffer used this frame, off when the meshes don't fit in the ids
+		static constexpr uint32_t VISIBILITY_TRIANGLE_BITS{ 24 };
+		static constexpr uint32_t VISIBILITY_TRIANGLE_MASK{ (1u << VISIBILITY_TRIANGLE_BITS) - 1 };
+		static constexpr uint32_t MAX_VISIBILITY_MESH_INDEX{ (1u << (32 - VISIBILITY_TRIANGLE_BITS)) - 2 };	// The last mesh index is kept free for INVALID_VISIBILITY_ID
+		static constexpr uint32_t INVALID_VISIBILITY_ID{ 0xFFFFFFFF };
+
+		// Farthest depth stored in every raster block and tile, triangles behind it can't pass the depth test
+		float* m_pBlockMaxDepth{ nullptr };
+		float* m_pTileMaxDepth{ nullptr };
+		int m_DepthBlockCountX{};
+		int m_DepthBlockCountY{};
+
+		// Shaded colors per channel, turned into pixels of the back buffer once the frame is done
+		float* m_pColorBufferR{ nullptr };
+		float* m_pColorBufferG{ nullptr };
+		float* m_pColorBufferB{ nullptr };
+		PixelResolver m_PixelResolver{};
+		std::vector<int> m_ScreenRows{};
+
 		Camera* m_CameraPtr;
 		DebugRenderMode m_RenderMode;
 
@@ -106,6 +226,7 @@ namespace dae
 		std::vector<Light> m_WorldLights;
 		std::map <std::string, Material* > m_MaterialPtrMap;
 		Material* defaultMaterial;
+		const Texture* m_pUVGridTexture{};	// Shown in the UV color mode
 
 		ColorRGB m_AmbientColor{ 0.025f,0.025f ,0.025f };
 		int m_ClearColor{ 20};
@@ -123,6 +244,46 @@ namespace dae
 
 		float m_SpinSpeed{ 0.5f };
 
-		std::vector<uint32_t> m_Integers{};
+		static constexpr int TILE_SIZE{ 64 };
+		static constexpr int RASTER_BLOCK_SIZE{ 8 };	// Tiles are a multiple of blocks
+		static constexpr int RASTER_SPAN_SIZE{ 4 };	// Pixels of a block row that are tested at once
+		static constexpr int SUBPIXEL_BITS{ 4 };
+		static constexpr int SUBPIXEL_STEPS{ 1 << SUBPIXEL_BITS };
+		static constexpr float HIZ_TOLERANCE{ 1e-6f };	// Rounding of interpolated depth, keeps rejection conservative
+		static constexpr int64_t MAX_FIXED_COORDINATE{ 1 << 21 };	// Keeps edge values of a block within 32 bits
+
+		// Outcodes, one bit for every plane a vertex is outside of
+		static constexpr uint32_t CLIP_LEFT{ 1 << 0 };
+		static constexpr uint32_t CLIP_RIGHT{ 1 << 1 };
+		static constexpr uint32_t CLIP_BOTTOM{ 1 << 2 };
+		static constexpr uint32_t CLIP_TOP{ 1 << 3 };
+		static constexpr uint32_t CLIP_NEAR{ 1 << 4 };
+		static constexpr uint32_t CLIP_FAR{ 1 << 5 };
+		static constexpr uint32_t CLIP_GUARD_LEFT{ 1 << 6 };
+		static constexpr uint32_t CLIP_GUARD_RIGHT{ 1 << 7 };
+		static constexpr uint32_t CLIP_GUARD_BOTTOM{ 1 << 8 };
+		static constexpr uint32_t CLIP_GUARD_TOP{ 1 << 9 };
+		static constexpr uint32_t CLIP_FRUSTUM{ CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP | CLIP_NEAR | CLIP_FAR };
+		static constexpr uint32_t CLIP_NEEDS_CLIPPING{ CLIP_NEAR | CLIP_GUARD_LEFT | CLIP_GUARD_RIGHT | CLIP_GUARD_BOTTOM | CLIP_GUARD_TOP };
+
+		// Size of the guard band in NDC, triangles within it are only clamped to the screen
+		// At 16 the screen positions fit MAX_FIXED_COORDINATE for screens up to 15000 pixels wide
+		static constexpr float GUARD_BAND{ 16.0f };
+		static constexpr int MAX_CLIP_VERTICES{ 8 };	// Every clipped plane adds at most one vertex to the triangle
+		int m_TileCountX{};
+		int m_TileCountY{};
+		std::vector<Tile> m_Tiles{};
+
+		uint32_t m_DrawnClusterCount{};
+		uint32_t m_CulledClusterCount{};	// Outside of the frustum
+		uint32_t m_BackFacingClusterCount{};
+
+		// Triangles per tile, one set of bins per chunk of the triangle order
+		std::vector<uint32_t> m_BinChunks{};
+		std::vector<std::vector<uint32_t>> m_TileBins{};
+
+		// Lights that can reach each tile, pixels only shade against the list of their tile
+		std::vector<std::vector<uint32_t>> m_TileLights{};
+		static constexpr float LIGHT_CUTOFF_RADIANCE{ 0.001f };	// Point lights are culled where they get darker than this
 	};
 }
@@ -92,6 +92,12 @@ int main(int argc, char* args[])
 					renderer.CycleRenderMode();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
 					renderer.ToggleLinearDepth();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+					renderer.ToggleToneMapping();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
+					renderer.ToggleGammaCorrection();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F11)
+					renderer.ToggleVisibilityBuffer();
 				if (e.key.keysym.scancode == SDL_SCANCODE_X)
 				{
 					takeScreenshotOfCurrentFrame = true;
@@ -146,6 +152,7 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << timer.GetdFPS() << std::endl;
+			std::cout << "Clusters drawn: " << renderer.GetDrawnClusterCount() << " culled: " << renderer.GetCulledClusterCount() << " back facing: " << renderer.GetBackFacingClusterCount() << std::endl;
 		}
 
 		//Save screenshot after full render
@@ -0,0 +1,137 @@
+#include "BatchRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+#include "Camera.h"
+#include "Renderer.h"
+#include "Scene.h"
+
+namespace dae
+{
+	BatchRenderer::BatchRenderer(const Scene* pScene, int concurrentJobs) :
+		m_pScene(pScene),
+		m_ConcurrentJobs(std::max(concurrentJobs, 1))
+	{
+	}
+
+	void BatchRenderer::AddView(const BatchView& view)
+	{
+		m_Views.push_back(view);
+	}
+
+	int BatchRenderer::RenderAll()
+	{
+		const auto startTime{ std::chrono::high_resolution_clock::now() };
+
+		std::atomic<size_t> nextView{ 0 };
+		std::atomic<int> savedCount{ 0 };
+		std::mutex printMutex{};
+
+		const auto renderJobs = [&]()
+		{
+			// Renderers are kept while the resolution stays the same, so their buffers are only made once per job thread
+			std::unique_ptr<Renderer> pRenderer{};
+			std::vector<uint32_t> tileIndices{};
+
+			for (size_t viewIndex{ nextView++ }; viewIndex < m_Views.size(); viewIndex = nextView++)
+			{
+				const BatchView& view{ m_Views[viewIndex] };
+				const auto viewStartTime{ std::chrono::high_resolution_clock::now() };
+
+				if (!pRenderer || pRenderer->GetWidth() != view.width || pRenderer->GetHeight() != view.height)
+				{
+					pRenderer = std::make_unique<Renderer>(view.width, view.height);
+					pRenderer->SetIncrementalEnabled(false);
+
+					if (!pRenderer->HasBuffer())
+					{
+						pRenderer.reset();
+
+						const std::lock_guard lock{ printMutex };
+						std::cout << std::format("[{}/{}] {} could not be rendered at {}x{}", viewIndex + 1, m_Views.size(), view.outputPath, view.width, view.height) << std::endl;
+						continue;
+					}
+
+					tileIndices.resize(pRenderer->GetTileCount());
+					std::iota(tileIndices.begin(), tileIndices.end(), 0);
+				}
+
+				// Every job has its own camera, the one of the scene is left alone
+				Camera camera{};
+				camera.SetPosition(view.origin);
+				camera.SetFOV(view.fovAngle);
+				camera.SetRotation(view.pitch, view.yaw);
+
+				pRenderer->PrepareFrame(m_pScene, camera);
+				pRenderer->RenderTiles(tileIndices);
+
+				// SDL_SaveBMP returns 0 when it worked
+				const bool isSaved{ !pRenderer->SaveBufferToImage(view.outputPath) };
+				if (isSaved)
+					++savedCount;
+
+				const std::chrono::duration<float, std::milli> viewTime{ std::chrono::high_resolution_clock::now() - viewStartTime };
+
+				const std::lock_guard lock{ printMutex };
+				std::cout << std::format("[{}/{}] {} {} in {:.1f} ms", viewIndex + 1, m_Views.size(), view.outputPath, isSaved ? "saved" : "could not be saved", viewTime.count()) << std::endl;
+			}
+		};
+
+		const int jobCount{ std::min(m_ConcurrentJobs, static_cast<int>(m_Views.size())) };
+
+		std::vector<std::thread> jobThreads{};
+		for (int jobIndex{ 1 }; jobIndex < jobCount; ++jobIndex)
+			jobThreads.emplace_back(renderJobs);
+
+		renderJobs();
+
+		for (std::thread& jobThread : jobThreads)
+			jobThread.join();
+
+		const std::chrono::duration<float> totalTime{ std::chrono::high_resolution_clock::now() - startTime };
+		std::cout << std::format("Rendered {} views in {:.2f} s ({:.2f} views per second)", m_Views.size(), totalTime.count(), static_cast<float>(m_Views.size()) / totalTime.count()) << std::endl;
+
+		return savedCount;
+	}
+
+	bool BatchRenderer::LoadViews(const std::string& filePath, std::vector<BatchView>& views)
+	{
+		std::ifstream file(filePath);
+		if (!file)
+			return false;
+
+		std::string line{};
+		while (std::getline(file, line))
+		{
+			// Empty lines and lines starting with # are skipped
+			if (line.empty() || line[0] == '#')
+				continue;
+
+			std::istringstream lineStream{ line };
+			BatchView view{};
+
+			const bool isValid
+			{
+				lineStream >> view.origin.x >> view.origin.y >> view.origin.z >> view.pitch >> view.yaw >> view.fovAngle >> view.width >> view.height >> view.outputPath &&
+				view.width > 0 && view.height > 0 && view.width <= MAX_VIEW_SIZE && view.height <= MAX_VIEW_SIZE
+			};
+
+			if (isValid)
+				views.push_back(view);
+			else
+				std::cout << "Skipped view line: " << line << std::endl;
+		}
+
+		return true;
+	}
+}
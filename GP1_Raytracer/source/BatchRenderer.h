@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	class Scene;
+
+	// One image to render, rotation and fov in degrees
+	struct BatchView
+	{
+		Vector3 origin{};
+		float pitch{};
+		float yaw{};
+		float fovAngle{ 45.0f };
+		int width{ 640 };
+		int height{ 480 };
+		std::string outputPath{};
+	};
+
+	// Renders a queue of views of one loaded scene, the scene is only read so all jobs share it
+	// A few jobs run at the same time, so while one is saving its image or starting up the others keep the cores busy
+	class BatchRenderer final
+	{
+	public:
+		BatchRenderer(const Scene* pScene, int concurrentJobs = 2);
+		~BatchRenderer() = default;
+
+		BatchRenderer(const BatchRenderer&) = delete;
+		BatchRenderer(BatchRenderer&&) noexcept = delete;
+		BatchRenderer& operator=(const BatchRenderer&) = delete;
+		BatchRenderer& operator=(BatchRenderer&&) noexcept = delete;
+
+		void AddView(const BatchView& view);
+
+		// Every image is written as soon as it is done, returns the amount of images that could be saved
+		int RenderAll();
+
+		// Every line of the file is one view: x y z pitch yaw fov width height outputPath
+		static bool LoadViews(const std::string& filePath, std::vector<BatchView>& views);
+
+	private:
+		static constexpr int MAX_VIEW_SIZE{ 16384 };	// Per side, larger images are skipped when loading views
+
+		const Scene* m_pScene{};
+		int m_ConcurrentJobs{};
+		std::vector<BatchView> m_Views{};
+	};
+}
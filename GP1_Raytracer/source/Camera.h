@@ -87,6 +87,20 @@ namespace dae
 			cameraPitch = pitch;
 			targetCameraYaw = yaw;
 			cameraYaw = yaw;
+
+			// Also apply it right away, scenes that are rendered without updating the camera would otherwise ignore it
+			forward = CalculatePitchYawRotation().TransformVector(Vector3::UnitZ);
+		}
+
+		Matrix CalculatePitchYawRotation() const
+		{
+			return
+			{
+				Vector3{cosf(cameraYaw), 0, sinf(cameraYaw)},
+				Vector3{sinf(cameraYaw) * sinf(cameraPitch), cosf(cameraPitch), -sinf(cameraPitch) * cosf(cameraYaw)},
+				Vector3{-cosf(cameraPitch) * sinf(cameraYaw), sinf(cameraPitch), cosf(cameraPitch) * cosf(cameraYaw)},
+				Vector3::Zero
+			};
 		}
 
 		void HandleCameraMovement(const float deltaTime)
@@ -143,13 +157,7 @@ namespace dae
 			cameraPitch = Jul::Lerp(cameraPitch, targetCameraPitch, deltaTime / cameraRotateSmoothing);
 			cameraYaw = Jul::Lerp(cameraYaw, targetCameraYaw, deltaTime / cameraRotateSmoothing);
 
-			const Matrix pitchYawRotation
-			{
-				Vector3{cosf(cameraYaw), 0, sinf(cameraYaw)},
-				Vector3{sinf(cameraYaw) * sinf(cameraPitch), cosf(cameraPitch), -sinf(cameraPitch) * cosf(cameraYaw)},
-				Vector3{-cosf(cameraPitch) * sinf(cameraYaw), sinf(cameraPitch), cosf(cameraPitch) * cosf(cameraYaw)},
-				Vector3::Zero
-			};
+			const Matrix pitchYawRotation{ CalculatePitchYawRotation() };
 
 			forward = Vector3::UnitZ;
 			forward = pitchYawRotation.TransformVector(forward);
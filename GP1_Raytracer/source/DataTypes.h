@@ -1,5 +1,6 @@
 #pragma once
 #include <cassert>
+#include <cstdint>
 
 #include "Math.h"
 #include "vector"
@@ -89,6 +90,9 @@ namespace dae
 		std::vector<Vector3> transformedPositions{};
 		//std::vector<Vector3> transformedNormals{};
 
+		// Bumped every time the transformed positions are rebuilt, used by the renderer to detect moving meshes
+		uint32_t transformVersion{ 0 };
+
 		void Translate(const Vector3& translation)
 		{
 			translationTransform = Matrix::CreateTranslation(translation);
@@ -174,6 +178,7 @@ namespace dae
 				transformedPositions.emplace_back(finalTransform.TransformPoint(position));
 			}
 			UpdateTransformedAAB(finalTransform);
+			++transformVersion;
 		}
 
 		void UpdateAABB()
@@ -219,7 +224,7 @@ namespace dae
 			tMinAABB = Vector3::Min(tAABB, tMinAABB);
 			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
 
-			tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, minAABB.z);
+			tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, maxAABB.z);
 			tMinAABB = Vector3::Min(tAABB, tMinAABB);
 			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
 
@@ -253,6 +258,20 @@ namespace dae
 	};
 #pragma endregion
 #pragma region MISC
+	// Side planes of a view pyramid, all going through the origin with their normals pointing inwards
+	struct Frustum
+	{
+		Vector3 origin{};
+		Vector3 normals[4]{};
+	};
+
+	// Geometry a group of rays can possibly hit, planes are infinite and always tested
+	struct GeometryCandidates
+	{
+		std::vector<int> sphereIndices{};
+		std::vector<int> meshIndices{};
+	};
+
 	struct Ray
 	{
 		Vector3 origin{};
@@ -270,6 +289,9 @@ namespace dae
 
 		bool didHit{ false };
 		unsigned char materialIndex{ 0 };
+
+		// Index of the hit primitive in scene order (planes, spheres, meshes), -1 when nothing was hit
+		int primitiveId{ -1 };
 	};
 #pragma endregion
 }
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <execution>
+#include <immintrin.h>
+#include <numeric>
+
+namespace dae
+{
+	namespace
+	{
+		// B3 spline, the 5x5 kernel is the outer product of this with itself
+		constexpr float KERNEL[3]{ 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+		// Minimum amount the albedo gets clamped to before dividing, keeps black surfaces from blowing up
+		constexpr float MIN_ALBEDO{ 0.01f };
+
+		constexpr float MIN_DEPTH{ 0.001f };
+		constexpr float MIN_WEIGHT{ 1e-6f };
+
+		// e^x for x <= 0, 2^x split in an integer part written to the exponent and a polynomial for the fraction
+		inline __m128 FastExp(__m128 x)
+		{
+			x = _mm_max_ps(x, _mm_set1_ps(-80.0f));
+			const __m128 y{ _mm_mul_ps(x, _mm_set1_ps(1.44269504f)) };
+
+			// Truncation rounds towards zero, correct it to a floor for negative values
+			__m128 whole{ _mm_cvtepi32_ps(_mm_cvttps_epi32(y)) };
+			whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, y), _mm_set1_ps(1.0f)));
+			const __m128 fraction{ _mm_sub_ps(y, whole) };
+
+			__m128 polynomial{ _mm_set1_ps(0.0794220f) };
+			polynomial = _mm_add_ps(_mm_mul_ps(polynomial, fraction), _mm_set1_ps(0.2244843f));
+			polynomial = _mm_add_ps(_mm_mul_ps(polynomial, fraction), _mm_set1_ps(0.6960656f));
+			polynomial = _mm_add_ps(_mm_mul_ps(polynomial, fraction), _mm_set1_ps(1.0f));
+
+			const __m128i exponent{ _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(whole), _mm_set1_epi32(127)), 23) };
+			return _mm_mul_ps(polynomial, _mm_castsi128_ps(exponent));
+		}
+
+		inline __m128 Abs(__m128 value)
+		{
+			return _mm_andnot_ps(_mm_set1_ps(-0.0f), value);
+		}
+	}
+
+	Denoiser::Denoiser(int width, int height, int tileSize) :
+		m_Width(width),
+		m_Height(height),
+		m_TileSize(tileSize)
+	{
+		m_TileCountX = (m_Width + m_TileSize - 1) / m_TileSize;
+		const int tileCountY{ (m_Height + m_TileSize - 1) / m_TileSize };
+
+		m_TileIndices.resize(static_cast<size_t>(m_TileCountX) * tileCountY);
+		std::iota(m_TileIndices.begin(), m_TileIndices.end(), 0);
+
+		const size_t pixelCount{ static_cast<size_t>(m_Width) * m_Height };
+
+		m_NormalX.resize(pixelCount);
+		m_NormalY.resize(pixelCount);
+		m_NormalZ.resize(pixelCount);
+		m_Depth.resize(pixelCount, MISS_DEPTH);
+		m_AlbedoR.resize(pixelCount, 1.0f);
+		m_AlbedoG.resize(pixelCount, 1.0f);
+		m_AlbedoB.resize(pixelCount, 1.0f);
+
+		for (ColorPlanes* pPlanes : { &m_Input, &m_PassBuffers[0], &m_PassBuffers[1] })
+		{
+			pPlanes->r.resize(pixelCount);
+			pPlanes->g.resize(pixelCount);
+			pPlanes->b.resize(pixelCount);
+		}
+
+		m_pResult = &m_Input;
+	}
+
+	void Denoiser::SetSample(int pixelIndex, const ColorRGB& color, const ColorRGB& albedo, const Vector3& normal, float depth)
+	{
+		m_NormalX[pixelIndex] = normal.x;
+		m_NormalY[pixelIndex] = normal.y;
+		m_NormalZ[pixelIndex] = normal.z;
+		m_Depth[pixelIndex] = std::min(depth, MISS_DEPTH);
+		m_AlbedoR[pixelIndex] = albedo.r;
+		m_AlbedoG[pixelIndex] = albedo.g;
+		m_AlbedoB[pixelIndex] = albedo.b;
+
+		// Filter the lighting only, so texture and material detail is not blurred away
+		m_Input.r[pixelIndex] = color.r / std::max(albedo.r, MIN_ALBEDO);
+		m_Input.g[pixelIndex] = color.g / std::max(albedo.g, MIN_ALBEDO);
+		m_Input.b[pixelIndex] = color.b / std::max(albedo.b, MIN_ALBEDO);
+	}
+
+	void Denoiser::Denoise()
+	{
+		const ColorPlanes* pSource{ &m_Input };
+
+		for (int passIndex{}; passIndex < PASS_COUNT; ++passIndex)
+		{
+			ColorPlanes& destination{ m_PassBuffers[passIndex % 2] };
+
+			std::for_each(std::execution::par, m_TileIndices.begin(), m_TileIndices.end(), [this, passIndex, pSource, &destination](const uint32_t tileIndex)
+				{
+					FilterTile(tileIndex, passIndex, *pSource, destination);
+				});
+
+			pSource = &destination;
+		}
+
+		m_pResult = pSource;
+	}
+
+	ColorRGB Denoiser::GetColor(int pixelIndex) const
+	{
+		return
+		{
+			m_pResult->r[pixelIndex] * std::max(m_AlbedoR[pixelIndex], MIN_ALBEDO),
+			m_pResult->g[pixelIndex] * std::max(m_AlbedoG[pixelIndex], MIN_ALBEDO),
+			m_pResult->b[pixelIndex] * std::max(m_AlbedoB[pixelIndex], MIN_ALBEDO)
+		};
+	}
+
+	void Denoiser::FilterTile(uint32_t tileIndex, int passIndex, const ColorPlanes& source, ColorPlanes& destination) const
+	{
+		const int tileMinX{ static_cast<int>(tileIndex) % m_TileCountX * m_TileSize };
+		const int tileMinY{ static_cast<int>(tileIndex) / m_TileCountX * m_TileSize };
+		const int tileMaxX{ std::min(tileMinX + m_TileSize, m_Width) };
+		const int tileMaxY{ std::min(tileMinY + m_TileSize, m_Height) };
+
+		// Every pass doubles the distance between the kernel taps, the color gets less say the wider the kernel gets
+		const int stepSize{ 1 << passIndex };
+		const float colorSigma{ COLOR_SIGMA / static_cast<float>(stepSize) };
+
+		const __m128 inverseColorSigma{ _mm_set1_ps(1.0f / (colorSigma * colorSigma)) };
+		const __m128 inverseAlbedoSigma{ _mm_set1_ps(1.0f / (ALBEDO_SIGMA * ALBEDO_SIGMA)) };
+		const __m128 depthSigma{ _mm_set1_ps(DEPTH_SIGMA * static_cast<float>(stepSize)) };
+		const __m128 zero{ _mm_setzero_ps() };
+		const __m128 laneOffsets{ _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f) };
+		const __m128 widthFloat{ _mm_set1_ps(static_cast<float>(m_Width)) };
+
+		// Loads four pixels of a row, lanes that fall outside of the screen read the edge pixel and get masked out by the caller
+		const auto load = [this](const std::vector<float>& plane, int rowStart, int x) -> __m128
+		{
+			if (x >= 0 && x + 3 < m_Width)
+				return _mm_loadu_ps(&plane[rowStart + x]);
+
+			const auto clamped = [this, &plane, rowStart](int laneX) { return plane[rowStart + std::clamp(laneX, 0, m_Width - 1)]; };
+			return _mm_set_ps(clamped(x + 3), clamped(x + 2), clamped(x + 1), clamped(x));
+		};
+
+		for (int pixelY{ tileMinY }; pixelY < tileMaxY; ++pixelY)
+		{
+			const int centerRow{ pixelY * m_Width };
+
+			for (int pixelX{ tileMinX }; pixelX < tileMaxX; pixelX += 4)
+			{
+				const __m128 centerNormalX{ load(m_NormalX, centerRow, pixelX) };
+				const __m128 centerNormalY{ load(m_NormalY, centerRow, pixelX) };
+				const __m128 centerNormalZ{ load(m_NormalZ, centerRow, pixelX) };
+				const __m128 centerDepth{ load(m_Depth, centerRow, pixelX) };
+				const __m128 centerAlbedoR{ load(m_AlbedoR, centerRow, pixelX) };
+				const __m128 centerAlbedoG{ load(m_AlbedoG, centerRow, pixelX) };
+				const __m128 centerAlbedoB{ load(m_AlbedoB, centerRow, pixelX) };
+				const __m128 centerR{ load(source.r, centerRow, pixelX) };
+				const __m128 centerG{ load(source.g, centerRow, pixelX) };
+				const __m128 centerB{ load(source.b, centerRow, pixelX) };
+
+				const __m128 inverseDepthRange{ _mm_div_ps(_mm_set1_ps(1.0f), _mm_mul_ps(depthSigma, _mm_max_ps(centerDepth, _mm_set1_ps(MIN_DEPTH)))) };
+
+				__m128 sumR{ zero };
+				__m128 sumG{ zero };
+				__m128 sumB{ zero };
+				__m128 sumWeight{ zero };
+
+				for (int kernelY{ -2 }; kernelY <= 2; ++kernelY)
+				{
+					const int tapY{ pixelY + kernelY * stepSize };
+					if (tapY < 0 || tapY >= m_Height)
+						continue;
+
+					const int tapRow{ tapY * m_Width };
+
+					for (int kernelX{ -2 }; kernelX <= 2; ++kernelX)
+					{
+						const int tapX{ pixelX + kernelX * stepSize };
+
+						// Lanes outside of the screen don't contribute
+						const __m128 laneX{ _mm_add_ps(_mm_set1_ps(static_cast<float>(tapX)), laneOffsets) };
+						const __m128 inside{ _mm_and_ps(_mm_cmpge_ps(laneX, zero), _mm_cmplt_ps(laneX, widthFloat)) };
+
+						// Normal, surfaces facing away get nothing
+						__m128 normalWeight
+						{
+							_mm_add_ps(_mm_add_ps(
+								_mm_mul_ps(centerNormalX, load(m_NormalX, tapRow, tapX)),
+								_mm_mul_ps(centerNormalY, load(m_NormalY, tapRow, tapX))),
+								_mm_mul_ps(centerNormalZ, load(m_NormalZ, tapRow, tapX)))
+						};
+						normalWeight = _mm_max_ps(normalWeight, zero);
+						for (int powerStep{}; powerStep < NORMAL_POWER_STEPS; ++powerStep)
+							normalWeight = _mm_mul_ps(normalWeight, normalWeight);
+
+						// Depth, albedo and color all end up in one exponent
+						const __m128 depthDistance{ _mm_mul_ps(Abs(_mm_sub_ps(centerDepth, load(m_Depth, tapRow, tapX))), inverseDepthRange) };
+
+						const __m128 albedoDeltaR{ _mm_sub_ps(centerAlbedoR, load(m_AlbedoR, tapRow, tapX)) };
+						const __m128 albedoDeltaG{ _mm_sub_ps(centerAlbedoG, load(m_AlbedoG, tapRow, tapX)) };
+						const __m128 albedoDeltaB{ _mm_sub_ps(centerAlbedoB, load(m_AlbedoB, tapRow, tapX)) };
+						const __m128 albedoDistance
+						{
+							_mm_mul_ps(_mm_add_ps(_mm_add_ps(
+								_mm_mul_ps(albedoDeltaR, albedoDeltaR),
+								_mm_mul_ps(albedoDeltaG, albedoDeltaG)),
+								_mm_mul_ps(albedoDeltaB, albedoDeltaB)), inverseAlbedoSigma)
+						};
+
+						const __m128 tapR{ load(source.r, tapRow, tapX) };
+						const __m128 tapG{ load(source.g, tapRow, tapX) };
+						const __m128 tapB{ load(source.b, tapRow, tapX) };
+						const __m128 colorDeltaR{ _mm_sub_ps(centerR, tapR) };
+						const __m128 colorDeltaG{ _mm_sub_ps(centerG, tapG) };
+						const __m128 colorDeltaB{ _mm_sub_ps(centerB, tapB) };
+						const __m128 colorDistance
+						{
+							_mm_mul_ps(_mm_add_ps(_mm_add_ps(
+								_mm_mul_ps(colorDeltaR, colorDeltaR),
+								_mm_mul_ps(colorDeltaG, colorDeltaG)),
+								_mm_mul_ps(colorDeltaB, colorDeltaB)), inverseColorSigma)
+						};
+
+						const __m128 edgeWeight{ FastExp(_mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(depthDistance, albedoDistance), colorDistance))) };
+
+						const float kernelWeight{ KERNEL[std::abs(kernelX)] * KERNEL[std::abs(kernelY)] };
+						const __m128 weight{ _mm_and_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(kernelWeight), normalWeight), edgeWeight), inside) };
+
+						sumR = _mm_add_ps(sumR, _mm_mul_ps(weight, tapR));
+						sumG = _mm_add_ps(sumG, _mm_mul_ps(weight, tapG));
+						sumB = _mm_add_ps(sumB, _mm_mul_ps(weight, tapB));
+						sumWeight = _mm_add_ps(sumWeight, weight);
+					}
+				}
+
+				// The center tap can still have no weight when it has no normal (missed the scene), keep its color then
+				const __m128 hasWeight{ _mm_cmpgt_ps(sumWeight, _mm_set1_ps(MIN_WEIGHT)) };
+				const __m128 inverseWeight{ _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(sumWeight, _mm_set1_ps(MIN_WEIGHT))) };
+
+				const __m128 resultR{ _mm_or_ps(_mm_and_ps(hasWeight, _mm_mul_ps(sumR, inverseWeight)), _mm_andnot_ps(hasWeight, centerR)) };
+				const __m128 resultG{ _mm_or_ps(_mm_and_ps(hasWeight, _mm_mul_ps(sumG, inverseWeight)), _mm_andnot_ps(hasWeight, centerG)) };
+				const __m128 resultB{ _mm_or_ps(_mm_and_ps(hasWeight, _mm_mul_ps(sumB, inverseWeight)), _mm_andnot_ps(hasWeight, centerB)) };
+
+				const int pixelIndex{ centerRow + pixelX };
+				if (pixelX + 3 < tileMaxX)
+				{
+					_mm_storeu_ps(&destination.r[pixelIndex], resultR);
+					_mm_storeu_ps(&destination.g[pixelIndex], resultG);
+					_mm_storeu_ps(&destination.b[pixelIndex], resultB);
+				}
+				else
+				{
+					// Tile ends in the middle of the four pixels, only write the ones that belong to it
+					alignas(16) float lanesR[4];
+					alignas(16) float lanesG[4];
+					alignas(16) float lanesB[4];
+					_mm_store_ps(lanesR, resultR);
+					_mm_store_ps(lanesG, resultG);
+					_mm_store_ps(lanesB, resultB);
+
+					for (int lane{}; pixelX + lane < tileMaxX; ++lane)
+					{
+						destination.r[pixelIndex + lane] = lanesR[lane];
+						destination.g[pixelIndex + lane] = lanesG[lane];
+						destination.b[pixelIndex + lane] = lanesB[lane];
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	// Edge-aware a-trous wavelet filter, every pass widens the 5x5 kernel by skipping pixels
+	// Neighbours only contribute when their normal, depth, albedo and color are close to the center pixel
+	class Denoiser final
+	{
+	public:
+		Denoiser(int width, int height, int tileSize);
+		~Denoiser() = default;
+
+		Denoiser(const Denoiser&) = delete;
+		Denoiser(Denoiser&&) noexcept = delete;
+		Denoiser& operator=(const Denoiser&) = delete;
+		Denoiser& operator=(Denoiser&&) noexcept = delete;
+
+		// Can be called from multiple threads as long as every pixel is only written by one of them
+		void SetSample(int pixelIndex, const ColorRGB& color, const ColorRGB& albedo, const Vector3& normal, float depth);
+
+		// Runs all passes, every pass is spread over the tiles on all cpu threads
+		void Denoise();
+
+		ColorRGB GetColor(int pixelIndex) const;
+
+	private:
+		// Colors are stored per channel so four neighbouring pixels can be loaded at once
+		struct ColorPlanes
+		{
+			std::vector<float> r{};
+			std::vector<float> g{};
+			std::vector<float> b{};
+		};
+
+		void FilterTile(uint32_t tileIndex, int passIndex, const ColorPlanes& source, ColorPlanes& destination) const;
+
+		static constexpr int PASS_COUNT{ 4 };
+		static constexpr float COLOR_SIGMA{ 0.6f };
+		static constexpr int NORMAL_POWER_STEPS{ 7 };	// Normal weight is dot^(2^7)
+		static constexpr float DEPTH_SIGMA{ 0.05f };	// Relative to the depth of the center pixel
+		static constexpr float ALBEDO_SIGMA{ 0.1f };
+		static constexpr float MISS_DEPTH{ 1e6f };
+
+		int m_Width{};
+		int m_Height{};
+		int m_TileSize{};
+		int m_TileCountX{};
+		std::vector<uint32_t> m_TileIndices{};
+
+		// Guides, written while tracing
+		std::vector<float> m_NormalX{};
+		std::vector<float> m_NormalY{};
+		std::vector<float> m_NormalZ{};
+		std::vector<float> m_Depth{};
+		std::vector<float> m_AlbedoR{};
+		std::vector<float> m_AlbedoG{};
+		std::vector<float> m_AlbedoB{};
+
+		// Noisy lighting with the albedo divided out, kept between frames for pixels that are not traced again
+		ColorPlanes m_Input{};
+		ColorPlanes m_PassBuffers[2]{};
+		const ColorPlanes* m_pResult{};
+	};
+}
@@ -0,0 +1,309 @@
+#include "DistributedRendering.h"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <thread>
+
+#include "Network.h"
+#include "Renderer.h"
+#include "Serialization.h"
+
+namespace dae
+{
+	RenderCoordinator::RenderCoordinator(Renderer* pRenderer, const std::string& sceneName, const StressSceneSettings& stressSettings) :
+		m_pRenderer(pRenderer),
+		m_SceneName(sceneName),
+		m_StressSettings(stressSettings)
+	{
+	}
+
+	RenderCoordinator::~RenderCoordinator()
+	{
+		for (const Worker& worker : m_Workers)
+		{
+			if (worker.pSocket)
+				worker.pSocket->SendPacket(static_cast<uint32_t>(PacketType::Shutdown), {});
+		}
+	}
+
+	bool RenderCoordinator::AcceptWorkers(uint16_t port, int workerCount)
+	{
+		const std::unique_ptr<Socket> pListenSocket{ Socket::Listen(port) };
+		if (!pListenSocket)
+			return false;
+
+		std::cout << "Waiting for " << workerCount << " workers on port " << port << std::endl;
+
+		std::vector<uint8_t> setupPayload{};
+		ByteWriter setupWriter{ setupPayload };
+		setupWriter.Write(static_cast<int32_t>(m_pRenderer->GetWidth()));
+		setupWriter.Write(static_cast<int32_t>(m_pRenderer->GetHeight()));
+		setupWriter.WriteString(m_SceneName);
+		setupWriter.Write(m_StressSettings);
+
+		while (static_cast<int>(m_Workers.size()) < workerCount)
+		{
+			Worker worker{};
+			worker.pSocket = pListenSocket->Accept();
+			if (!worker.pSocket || !worker.pSocket->SendPacket(static_cast<uint32_t>(PacketType::Setup), setupPayload))
+				continue;
+
+			// The worker answers once its scene is loaded
+			uint32_t packetType{};
+			std::vector<uint8_t> payload{};
+			if (!worker.pSocket->ReceivePacket(packetType, payload) || packetType != static_cast<uint32_t>(PacketType::Ready))
+				continue;
+
+			ByteReader reader{ payload };
+			reader.Read(worker.threadCount);
+			worker.threadCount = std::max(worker.threadCount, 1u);
+
+			std::cout << "Worker " << m_Workers.size() << " connected with " << worker.threadCount << " threads" << std::endl;
+			m_Workers.push_back(std::move(worker));
+		}
+
+		return true;
+	}
+
+	bool RenderCoordinator::RenderFrame(const Scene* pScene)
+	{
+		++m_FrameIndex;
+
+		std::vector<uint8_t> framePayload{};
+		ByteWriter frameWriter{ framePayload };
+		frameWriter.Write(m_FrameIndex);
+		frameWriter.Write(static_cast<int32_t>(m_pRenderer->GetLightMode()));
+		frameWriter.Write(m_pRenderer->AreShadowsEnabled());
+		frameWriter.Write(m_pRenderer->IsToneMappingEnabled());
+		frameWriter.Write(m_pRenderer->IsGammaCorrectionEnabled());
+		pScene->WriteFrameState(frameWriter);
+
+		// Taken from the back, so reversed to hand them out top to bottom
+		std::vector<uint32_t> pendingTiles(m_pRenderer->GetTileCount());
+		std::iota(pendingTiles.rbegin(), pendingTiles.rend(), 0);
+		uint32_t remainingTiles{ m_pRenderer->GetTileCount() };
+
+		for (Worker& worker : m_Workers)
+		{
+			if (!worker.pSocket)
+				continue;
+
+			worker.tilesInFlight.clear();
+			if (!worker.pSocket->SendPacket(static_cast<uint32_t>(PacketType::Frame), framePayload))
+				DropWorker(worker, pendingTiles);
+		}
+
+		std::vector<uint32_t> pixels{};
+		std::vector<uint8_t> payload{};
+
+		while (remainingTiles > 0)
+		{
+			std::vector<const Socket*> sockets{};
+			std::vector<Worker*> socketWorkers{};
+
+			for (Worker& worker : m_Workers)
+			{
+				if (!worker.pSocket)
+					continue;
+
+				SendTiles(worker, pendingTiles);
+				if (!worker.pSocket)
+					continue;
+
+				sockets.push_back(worker.pSocket.get());
+				socketWorkers.push_back(&worker);
+			}
+
+			if (sockets.empty())
+			{
+				std::cout << "No workers left to render with" << std::endl;
+				return false;
+			}
+
+			for (const size_t socketIndex : Socket::WaitForReadable(sockets))
+			{
+				Worker& worker{ *socketWorkers[socketIndex] };
+
+				uint32_t packetType{};
+				if (!worker.pSocket->ReceivePacket(packetType, payload))
+				{
+					DropWorker(worker, pendingTiles);
+					continue;
+				}
+
+				if (packetType != static_cast<uint32_t>(PacketType::TileResult))
+					continue;
+
+				ByteReader reader{ payload };
+				uint32_t frameIndex{};
+				uint32_t tileIndex{};
+				if (!reader.Read(frameIndex) || !reader.Read(tileIndex) || !reader.ReadVector(pixels) || frameIndex != m_FrameIndex)
+					continue;
+
+				const auto inFlightIt{ std::find(worker.tilesInFlight.begin(), worker.tilesInFlight.end(), tileIndex) };
+				if (inFlightIt == worker.tilesInFlight.end() || !m_pRenderer->WriteTile(tileIndex, pixels))
+					continue;
+
+				worker.tilesInFlight.erase(inFlightIt);
+				--remainingTiles;
+			}
+		}
+
+		m_pRenderer->Present();
+		return true;
+	}
+
+	void RenderCoordinator::SendTiles(Worker& worker, std::vector<uint32_t>& pendingTiles) const
+	{
+		const uint32_t batchSize{ worker.threadCount };
+
+		while (!pendingTiles.empty() && worker.tilesInFlight.size() + batchSize <= batchSize * BATCHES_IN_FLIGHT)
+		{
+			std::vector<uint32_t> batch{};
+			while (!pendingTiles.empty() && batch.size() < batchSize)
+			{
+				batch.push_back(pendingTiles.back());
+				pendingTiles.pop_back();
+			}
+
+			std::vector<uint8_t> payload{};
+			ByteWriter writer{ payload };
+			writer.Write(m_FrameIndex);
+			writer.WriteVector(batch);
+
+			worker.tilesInFlight.insert(worker.tilesInFlight.end(), batch.begin(), batch.end());
+
+			if (!worker.pSocket->SendPacket(static_cast<uint32_t>(PacketType::Tiles), payload))
+			{
+				DropWorker(worker, pendingTiles);
+				return;
+			}
+		}
+	}
+
+	void RenderCoordinator::DropWorker(Worker& worker, std::vector<uint32_t>& pendingTiles) const
+	{
+		std::cout << "Lost a worker, its tiles are given to the others" << std::endl;
+
+		pendingTiles.insert(pendingTiles.end(), worker.tilesInFlight.begin(), worker.tilesInFlight.end());
+		worker.tilesInFlight.clear();
+		worker.pSocket.reset();
+	}
+
+	bool RunRenderWorker(const std::string& host, uint16_t port)
+	{
+		const std::unique_ptr<Socket> pSocket{ Socket::Connect(host, port) };
+		if (!pSocket)
+		{
+			std::cout << "Could not connect to coordinator " << host << ":" << port << std::endl;
+			return false;
+		}
+
+		std::cout << "Connected to coordinator " << host << ":" << port << std::endl;
+
+		std::unique_ptr<Scene> pScene{};
+		std::unique_ptr<Renderer> pRenderer{};
+		uint32_t frameIndex{};
+
+		uint32_t packetType{};
+		std::vector<uint8_t> payload{};
+		std::vector<uint32_t> tiles{};
+		std::vector<uint32_t> pixels{};
+
+		while (pSocket->ReceivePacket(packetType, payload))
+		{
+			ByteReader reader{ payload };
+
+			switch (static_cast<PacketType>(packetType))
+			{
+			case PacketType::Setup:
+			{
+				int32_t width{};
+				int32_t height{};
+				std::string sceneName{};
+				StressSceneSettings stressSettings{};
+				if (!reader.Read(width) || !reader.Read(height) || !reader.ReadString(sceneName) || !reader.Read(stressSettings))
+					return false;
+
+				pScene.reset(CreateScene(sceneName, stressSettings));
+				if (!pScene)
+				{
+					std::cout << "Unknown scene " << sceneName << std::endl;
+					return false;
+				}
+
+				pScene->Initialize();
+
+				// Workers only see some tiles of every frame, so reusing pixels between frames is not possible
+				pRenderer = std::make_unique<Renderer>(width, height);
+				pRenderer->SetIncrementalEnabled(false);
+
+				if (!pRenderer->HasBuffer())
+					return false;
+
+				std::vector<uint8_t> readyPayload{};
+				ByteWriter writer{ readyPayload };
+				writer.Write(std::max(std::thread::hardware_concurrency(), 1u));
+
+				if (!pSocket->SendPacket(static_cast<uint32_t>(PacketType::Ready), readyPayload))
+					return false;
+
+				std::cout << "Scene " << sceneName << " loaded, rendering " << width << "x" << height << std::endl;
+				break;
+			}
+			case PacketType::Frame:
+			{
+				int32_t lightMode{};
+				bool shadowsEnabled{};
+				bool toneMappingEnabled{};
+				bool gammaCorrectionEnabled{};
+				if (!pScene || !reader.Read(frameIndex) || !reader.Read(lightMode) || !reader.Read(shadowsEnabled) ||
+					!reader.Read(toneMappingEnabled) || !reader.Read(gammaCorrectionEnabled) || !pScene->ReadFrameState(reader))
+					return false;
+
+				pRenderer->SetLightMode(lightMode);
+				pRenderer->SetShadowsEnabled(shadowsEnabled);
+				pRenderer->SetToneMappingEnabled(toneMappingEnabled);
+				pRenderer->SetGammaCorrectionEnabled(gammaCorrectionEnabled);
+				pRenderer->PrepareFrame(pScene.get());
+				break;
+			}
+			case PacketType::Tiles:
+			{
+				uint32_t tilesFrameIndex{};
+				if (!pRenderer || !reader.Read(tilesFrameIndex) || !reader.ReadVector(tiles) || tilesFrameIndex != frameIndex)
+					break;
+
+				tiles.erase(std::remove_if(tiles.begin(), tiles.end(), [&pRenderer](uint32_t tileIndex) { return tileIndex >= pRenderer->GetTileCount(); }), tiles.end());
+
+				// The whole batch is rendered at once so it is spread over all threads of this worker
+				pRenderer->RenderTiles(tiles);
+
+				for (const uint32_t tileIndex : tiles)
+				{
+					pRenderer->ReadTile(tileIndex, pixels);
+
+					std::vector<uint8_t> resultPayload{};
+					ByteWriter writer{ resultPayload };
+					writer.Write(frameIndex);
+					writer.Write(tileIndex);
+					writer.WriteVector(pixels);
+
+					if (!pSocket->SendPacket(static_cast<uint32_t>(PacketType::TileResult), resultPayload))
+						return false;
+				}
+				break;
+			}
+			case PacketType::Shutdown:
+				std::cout << "Coordinator finished" << std::endl;
+				return true;
+			default:
+				break;
+			}
+		}
+
+		std::cout << "Lost connection to coordinator" << std::endl;
+		return false;
+	}
+}
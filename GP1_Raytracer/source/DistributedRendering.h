@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Scene.h"
+
+namespace dae
+{
+	class Renderer;
+	class Socket;
+
+	enum class PacketType : uint32_t
+	{
+		Setup,		// Coordinator -> worker: resolution and which scene to build
+		Ready,		// Worker -> coordinator: scene is built, contains the amount of threads of the worker
+		Frame,		// Coordinator -> worker: render settings and everything that moved in the scene
+		Tiles,		// Coordinator -> worker: batch of tiles to render for the current frame
+		TileResult,	// Worker -> coordinator: pixels of one tile
+		Shutdown	// Coordinator -> worker: stop working
+	};
+
+	// Hands out the tiles of every frame to worker processes and copies the pixels they send back into the renderer
+	// Tiles are given out a batch at a time as workers finish, so faster workers end up doing more of the frame
+	class RenderCoordinator final
+	{
+	public:
+		RenderCoordinator(Renderer* pRenderer, const std::string& sceneName, const StressSceneSettings& stressSettings = {});
+		~RenderCoordinator();
+
+		RenderCoordinator(const RenderCoordinator&) = delete;
+		RenderCoordinator(RenderCoordinator&&) noexcept = delete;
+		RenderCoordinator& operator=(const RenderCoordinator&) = delete;
+		RenderCoordinator& operator=(RenderCoordinator&&) noexcept = delete;
+
+		// Blocks until the amount of workers connected and built their scene
+		bool AcceptWorkers(uint16_t port, int workerCount);
+
+		// Returns false when no worker is left to render the frame
+		bool RenderFrame(const Scene* pScene);
+
+	private:
+		struct Worker
+		{
+			std::unique_ptr<Socket> pSocket{};
+			uint32_t threadCount{ 1 };
+			std::vector<uint32_t> tilesInFlight{};
+		};
+
+		void SendTiles(Worker& worker, std::vector<uint32_t>& pendingTiles) const;
+		void DropWorker(Worker& worker, std::vector<uint32_t>& pendingTiles) const;
+
+		// Every worker gets a batch per thread, and a second one queued so it never waits on the network
+		static constexpr uint32_t BATCHES_IN_FLIGHT{ 2 };
+
+		Renderer* m_pRenderer{};
+		std::string m_SceneName{};
+		StressSceneSettings m_StressSettings{};
+
+		std::vector<Worker> m_Workers{};
+		uint32_t m_FrameIndex{};
+	};
+
+	// Connects to a coordinator and renders the tiles it asks for until it is told to stop
+	bool RunRenderWorker(const std::string& host, uint16_t port);
+}
@@ -0,0 +1,202 @@
+#include "IrradianceCache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <mutex>
+
+#include "Material.h"
+#include "Scene.h"
+#include "Utils.h"
+
+namespace dae
+{
+	namespace
+	{
+		// Small hash so the jitter of a record only depends on where it is, not on which thread made it
+		uint32_t HashPoint(const Vector3& point)
+		{
+			uint32_t hash{ std::bit_cast<uint32_t>(point.x) * 73856093u ^ std::bit_cast<uint32_t>(point.y) * 19349663u ^ std::bit_cast<uint32_t>(point.z) * 83492791u };
+			return hash == 0 ? 1u : hash;
+		}
+
+		float NextRandom(uint32_t& state)
+		{
+			// Xorshift, the top 24 bits become a float between 0 and 1
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return static_cast<float>(state >> 8) / 16777216.0f;
+		}
+	}
+
+	ColorRGB IrradianceCache::GetIrradiance(const Vector3& point, const Vector3& normal, const Scene& scene,
+		const std::vector<Light>& lights, const std::vector<Material*>& materials, bool shadowsEnabled)
+	{
+		ColorRGB irradiance{};
+
+		{
+			const std::shared_lock lock{ m_Mutex };
+			if (Interpolate(point, normal, irradiance))
+				return irradiance;
+		}
+
+		// Sampling is done without holding the lock, two threads might make a record at the same spot but that is harmless
+		const Record record{ Sample(point, normal, scene, lights, materials, shadowsEnabled) };
+
+		{
+			const std::unique_lock lock{ m_Mutex };
+			m_Cells[GetCellKey(GetCellCoordinate(point.x), GetCellCoordinate(point.y), GetCellCoordinate(point.z))].push_back(record);
+			++m_RecordCount;
+		}
+
+		return record.irradiance;
+	}
+
+	void IrradianceCache::Clear()
+	{
+		const std::unique_lock lock{ m_Mutex };
+		m_Cells.clear();
+		m_RecordCount = 0;
+	}
+
+	size_t IrradianceCache::GetRecordCount() const
+	{
+		const std::shared_lock lock{ m_Mutex };
+		return m_RecordCount;
+	}
+
+	bool IrradianceCache::Interpolate(const Vector3& point, const Vector3& normal, ColorRGB& irradiance) const
+	{
+		const int cellX{ GetCellCoordinate(point.x) };
+		const int cellY{ GetCellCoordinate(point.y) };
+		const int cellZ{ GetCellCoordinate(point.z) };
+
+		ColorRGB weightedIrradiance{};
+		float totalWeight{};
+
+		for (int offsetZ{ -1 }; offsetZ <= 1; ++offsetZ)
+		{
+			for (int offsetY{ -1 }; offsetY <= 1; ++offsetY)
+			{
+				for (int offsetX{ -1 }; offsetX <= 1; ++offsetX)
+				{
+					const auto cellIt{ m_Cells.find(GetCellKey(cellX + offsetX, cellY + offsetY, cellZ + offsetZ)) };
+					if (cellIt == m_Cells.end())
+						continue;
+
+					for (const Record& record : cellIt->second)
+					{
+						const Vector3 toPoint{ point - record.point };
+
+						// Records in front of the point can see things the point can't
+						if (Vector3::Dot(toPoint, normal + record.normal) < -0.1f * record.radius)
+							continue;
+
+						const float normalError{ std::sqrt(std::max(0.0f, 1.0f - Vector3::Dot(normal, record.normal))) };
+						const float error{ toPoint.Magnitude() / record.radius + normalError };
+
+						if (error >= ERROR_THRESHOLD)
+							continue;
+
+						const float weight{ 1.0f / std::max(error, 1e-4f) };
+						weightedIrradiance += record.irradiance * weight;
+						totalWeight += weight;
+					}
+				}
+			}
+		}
+
+		if (totalWeight <= 0.0f)
+			return false;
+
+		irradiance = weightedIrradiance / totalWeight;
+		return true;
+	}
+
+	IrradianceCache::Record IrradianceCache::Sample(const Vector3& point, const Vector3& normal, const Scene& scene,
+		const std::vector<Light>& lights, const std::vector<Material*>& materials, bool shadowsEnabled) const
+	{
+		// Any vector that is not parallel to the normal works to build the tangent frame
+		const Vector3 helper{ std::abs(normal.x) > 0.9f ? Vector3::UnitY : Vector3::UnitX };
+		const Vector3 tangent{ Vector3::Cross(helper, normal).Normalized() };
+		const Vector3 bitangent{ Vector3::Cross(normal, tangent) };
+
+		const Vector3 origin{ point + normal * NORMAL_OFFSET };
+		uint32_t randomState{ HashPoint(point) };
+
+		ColorRGB radianceSum{};
+		float inverseDistanceSum{};
+
+		for (int strataY{}; strataY < STRATA_PER_AXIS; ++strataY)
+		{
+			for (int strataX{}; strataX < STRATA_PER_AXIS; ++strataX)
+			{
+				const float u{ (static_cast<float>(strataX) + NextRandom(randomState)) / STRATA_PER_AXIS };
+				const float v{ (static_cast<float>(strataY) + NextRandom(randomState)) / STRATA_PER_AXIS };
+
+				// Cosine weighted, so the cosine term cancels out against the probability of the direction
+				const float radius{ std::sqrt(u) };
+				const float angle{ PI_2 * v };
+				const Vector3 direction
+				{
+					tangent * (radius * std::cos(angle)) +
+					bitangent * (radius * std::sin(angle)) +
+					normal * std::sqrt(std::max(0.0f, 1.0f - u))
+				};
+
+				HitRecord hit{};
+				scene.GetClosestHit(Ray{ origin, direction }, hit);
+
+				if (!hit.didHit)
+					continue;
+
+				inverseDistanceSum += 1.0f / std::max(hit.t, MIN_RADIUS);
+
+				// Only direct light is gathered at the sampled surface, one bounce of indirect light
+				Material* hitMaterial{ materials[hit.materialIndex] };
+				const Vector3 hitPointWithOffset{ hit.point + hit.normal * NORMAL_OFFSET };
+
+				for (const Light& light : lights)
+				{
+					const Vector3 lightToHitDirection{ hitPointWithOffset - light.origin };
+					const float lightToHitDistance{ lightToHitDirection.Magnitude() };
+					const Vector3 l{ lightToHitDirection / lightToHitDistance };
+
+					const float cosineLaw{ Vector3::Dot(hit.normal, -l) };
+					if (cosineLaw <= 0.0f)
+						continue;
+
+					if (shadowsEnabled && scene.DoesHit(Ray{ light.origin, l, 0.0f, lightToHitDistance }))
+						continue;
+
+					radianceSum += LightUtils::GetRadiance(light, hit.point) * hitMaterial->Shade(hit, -l, -direction) * cosineLaw;
+				}
+			}
+		}
+
+		constexpr float sampleCount{ static_cast<float>(STRATA_PER_AXIS * STRATA_PER_AXIS) };
+
+		Record record{};
+		record.point = point;
+		record.normal = normal;
+		record.irradiance = radianceSum * (PI / sampleCount);
+
+		// Close surfaces change the irradiance quickly, so records near them cover less
+		record.radius = inverseDistanceSum > 0.0f ? std::clamp(sampleCount / inverseDistanceSum, MIN_RADIUS, MAX_RADIUS) : MAX_RADIUS;
+
+		return record;
+	}
+
+	int IrradianceCache::GetCellCoordinate(float value)
+	{
+		return static_cast<int>(std::floor(value / CELL_SIZE));
+	}
+
+	uint64_t IrradianceCache::GetCellKey(int x, int y, int z)
+	{
+		// 21 bits per axis is plenty for the size of the scenes
+		constexpr uint64_t mask{ (uint64_t{ 1 } << 21) - 1 };
+		return (static_cast<uint64_t>(x) & mask) | (static_cast<uint64_t>(y) & mask) << 21 | (static_cast<uint64_t>(z) & mask) << 42;
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	class Scene;
+	class Material;
+
+	// World space cache of diffuse irradiance, based on Ward's irradiance caching
+	// Records are made when a hit has no record close enough, and nearby hits blend the records around them
+	class IrradianceCache final
+	{
+	public:
+		IrradianceCache() = default;
+		~IrradianceCache() = default;
+
+		IrradianceCache(const IrradianceCache&) = delete;
+		IrradianceCache(IrradianceCache&&) noexcept = delete;
+		IrradianceCache& operator=(const IrradianceCache&) = delete;
+		IrradianceCache& operator=(IrradianceCache&&) noexcept = delete;
+
+		// Can be called from multiple threads, records made by one thread are used by the others
+		ColorRGB GetIrradiance(const Vector3& point, const Vector3& normal, const Scene& scene,
+			const std::vector<Light>& lights, const std::vector<Material*>& materials, bool shadowsEnabled);
+
+		// Records are only valid for the lights and geometry they were sampled with
+		void Clear();
+		size_t GetRecordCount() const;
+
+	private:
+		struct Record
+		{
+			Vector3 point{};
+			Vector3 normal{};
+			ColorRGB irradiance{};
+			float radius{};	// Harmonic mean distance to the surfaces around the record
+		};
+
+		bool Interpolate(const Vector3& point, const Vector3& normal, ColorRGB& irradiance) const;
+		Record Sample(const Vector3& point, const Vector3& normal, const Scene& scene,
+			const std::vector<Light>& lights, const std::vector<Material*>& materials, bool shadowsEnabled) const;
+
+		static int GetCellCoordinate(float value);
+		static uint64_t GetCellKey(int x, int y, int z);
+
+		// The hemisphere is split in a grid of strata, one cosine weighted ray each
+		static constexpr int STRATA_PER_AXIS{ 8 };
+		static constexpr float ERROR_THRESHOLD{ 0.4f };	// Lower makes more records and less blotches
+		static constexpr float MIN_RADIUS{ 0.2f };
+		static constexpr float MAX_RADIUS{ 3.0f };
+		static constexpr float NORMAL_OFFSET{ 0.001f };
+
+		// A record is used up to ERROR_THRESHOLD * radius away, so only the neighbouring cells have to be searched
+		static constexpr float CELL_SIZE{ ERROR_THRESHOLD * MAX_RADIUS };
+
+		mutable std::shared_mutex m_Mutex{};
+		std::unordered_map<uint64_t, std::vector<Record>> m_Cells{};
+		size_t m_RecordCount{};
+	};
+}
@@ -28,6 +28,12 @@ namespace dae
 		 * \return color
 		 */
 		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+
+		/**
+		 * \brief Base color of the surface without any lighting, used as a guide by the denoiser
+		 * \return albedo
+		 */
+		virtual ColorRGB GetAlbedo() const = 0;
 	};
 #pragma endregion
 
@@ -46,6 +52,8 @@ namespace dae
 			return m_Color;
 		}
 
+		ColorRGB GetAlbedo() const override { return m_Color; }
+
 	private:
 		ColorRGB m_Color{colors::White};
 	};
@@ -65,6 +73,8 @@ namespace dae
 			return BRDF::Lambert(m_DiffuseReflectance,m_DiffuseColor);
 		}
 
+		ColorRGB GetAlbedo() const override { return m_DiffuseColor; }
+
 	private:
 		ColorRGB m_DiffuseColor{colors::White};
 		float m_DiffuseReflectance{1.f}; //kd
@@ -89,6 +99,8 @@ namespace dae
 				BRDF::Phong(m_SpecularReflectance,m_PhongExponent,l,-v,hitRecord.normal);
 		}
 
+		ColorRGB GetAlbedo() const override { return m_DiffuseColor; }
+
 	private:
 		ColorRGB m_DiffuseColor{colors::White};
 		float m_DiffuseReflectance{0.5f}; //kd
@@ -130,6 +142,8 @@ namespace dae
 			return specular + diffuse;
 		}
 
+		ColorRGB GetAlbedo() const override { return m_Albedo; }
+
 	private:
 		ColorRGB m_Albedo{0.955f, 0.637f, 0.538f}; //Copper
 		float m_Metalness{1.0f};
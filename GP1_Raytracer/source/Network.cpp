@@ -0,0 +1,232 @@
+#include "Network.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace dae
+{
+	namespace
+	{
+#ifdef _WIN32
+		constexpr SocketHandle INVALID_HANDLE{ INVALID_SOCKET };
+
+		// Winsock has to be started once before any socket is made
+		bool InitializeSockets()
+		{
+			static const bool isInitialized
+			{
+				[]()
+				{
+					WSADATA wsaData{};
+					return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+				}()
+			};
+
+			return isInitialized;
+		}
+
+		void CloseSocketHandle(SocketHandle handle) { closesocket(handle); }
+
+		constexpr int SEND_FLAGS{ 0 };
+#else
+		constexpr SocketHandle INVALID_HANDLE{ -1 };
+
+		bool InitializeSockets() { return true; }
+		void CloseSocketHandle(SocketHandle handle) { close(handle); }
+
+		// A worker that went away should show up as a failed send, not kill the process
+		constexpr int SEND_FLAGS{ MSG_NOSIGNAL };
+#endif
+
+		// Tiles are small messages, don't let them wait to be combined with others
+		void DisableNagle(SocketHandle handle)
+		{
+			int enabled{ 1 };
+			setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enabled), sizeof(enabled));
+		}
+
+		// Payloads bigger than this are treated as a broken connection
+		constexpr uint32_t MAX_PAYLOAD_SIZE{ 256 * 1024 * 1024 };
+	}
+
+	Socket::Socket(SocketHandle handle) :
+		m_Handle(handle)
+	{
+	}
+
+	Socket::~Socket()
+	{
+		if (m_Handle != INVALID_HANDLE)
+			CloseSocketHandle(m_Handle);
+	}
+
+	std::unique_ptr<Socket> Socket::Listen(uint16_t port)
+	{
+		if (!InitializeSockets())
+			return nullptr;
+
+		const SocketHandle handle{ socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) };
+		if (handle == INVALID_HANDLE)
+			return nullptr;
+
+		std::unique_ptr<Socket> pSocket{ new Socket(handle) };
+
+		int reuseAddress{ 1 };
+		setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuseAddress), sizeof(reuseAddress));
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+
+		if (bind(handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(handle, SOMAXCONN) != 0)
+		{
+			std::cout << "Could not listen on port " << port << std::endl;
+			return nullptr;
+		}
+
+		return pSocket;
+	}
+
+	std::unique_ptr<Socket> Socket::Connect(const std::string& host, uint16_t port)
+	{
+		if (!InitializeSockets())
+			return nullptr;
+
+		addrinfo hints{};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		addrinfo* pAddresses{};
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &pAddresses) != 0)
+		{
+			std::cout << "Could not resolve " << host << std::endl;
+			return nullptr;
+		}
+
+		std::unique_ptr<Socket> pSocket{};
+		for (const addrinfo* pAddress{ pAddresses }; pAddress != nullptr && !pSocket; pAddress = pAddress->ai_next)
+		{
+			const SocketHandle handle{ socket(pAddress->ai_family, pAddress->ai_socktype, pAddress->ai_protocol) };
+			if (handle == INVALID_HANDLE)
+				continue;
+
+			if (connect(handle, pAddress->ai_addr, static_cast<int>(pAddress->ai_addrlen)) != 0)
+			{
+				CloseSocketHandle(handle);
+				continue;
+			}
+
+			DisableNagle(handle);
+			pSocket.reset(new Socket(handle));
+		}
+
+		freeaddrinfo(pAddresses);
+		return pSocket;
+	}
+
+	std::unique_ptr<Socket> Socket::Accept() const
+	{
+		const SocketHandle handle{ accept(m_Handle, nullptr, nullptr) };
+		if (handle == INVALID_HANDLE)
+			return nullptr;
+
+		DisableNagle(handle);
+		return std::unique_ptr<Socket>{ new Socket(handle) };
+	}
+
+	bool Socket::SendAll(const void* pData, size_t size) const
+	{
+		const char* pBytes{ static_cast<const char*>(pData) };
+
+		while (size > 0)
+		{
+			const auto sent{ send(m_Handle, pBytes, static_cast<int>(size), SEND_FLAGS) };
+			if (sent <= 0)
+				return false;
+
+			pBytes += sent;
+			size -= static_cast<size_t>(sent);
+		}
+
+		return true;
+	}
+
+	bool Socket::ReceiveAll(void* pData, size_t size) const
+	{
+		char* pBytes{ static_cast<char*>(pData) };
+
+		while (size > 0)
+		{
+			const auto received{ recv(m_Handle, pBytes, static_cast<int>(size), 0) };
+			if (received <= 0)
+				return false;
+
+			pBytes += received;
+			size -= static_cast<size_t>(received);
+		}
+
+		return true;
+	}
+
+	bool Socket::SendPacket(uint32_t type, const std::vector<uint8_t>& payload) const
+	{
+		const uint32_t header[2]{ type, static_cast<uint32_t>(payload.size()) };
+
+		return SendAll(header, sizeof(header)) && (payload.empty() || SendAll(payload.data(), payload.size()));
+	}
+
+	bool Socket::ReceivePacket(uint32_t& type, std::vector<uint8_t>& payload) const
+	{
+		uint32_t header[2]{};
+		if (!ReceiveAll(header, sizeof(header)) || header[1] > MAX_PAYLOAD_SIZE)
+			return false;
+
+		type = header[0];
+		payload.resize(header[1]);
+
+		return payload.empty() || ReceiveAll(payload.data(), payload.size());
+	}
+
+	std::vector<size_t> Socket::WaitForReadable(const std::vector<const Socket*>& sockets)
+	{
+		fd_set readSet;
+		FD_ZERO(&readSet);
+
+		SocketHandle highestHandle{};
+		for (const Socket* pSocket : sockets)
+		{
+			FD_SET(pSocket->m_Handle, &readSet);
+			highestHandle = std::max(highestHandle, pSocket->m_Handle);
+		}
+
+		std::vector<size_t> readable{};
+		if (select(static_cast<int>(highestHandle + 1), &readSet, nullptr, nullptr, nullptr) <= 0)
+			return readable;
+
+		for (size_t socketIndex{}; socketIndex < sockets.size(); ++socketIndex)
+		{
+			if (FD_ISSET(sockets[socketIndex]->m_Handle, &readSet))
+				readable.push_back(socketIndex);
+		}
+
+		return readable;
+	}
+}
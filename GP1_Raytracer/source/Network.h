@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+#ifdef _WIN32
+	using SocketHandle = uintptr_t;
+#else
+	using SocketHandle = int;
+#endif
+
+	// Blocking TCP socket, works on top of winsock on windows and bsd sockets everywhere else
+	class Socket final
+	{
+	public:
+		~Socket();
+
+		Socket(const Socket&) = delete;
+		Socket(Socket&&) noexcept = delete;
+		Socket& operator=(const Socket&) = delete;
+		Socket& operator=(Socket&&) noexcept = delete;
+
+		static std::unique_ptr<Socket> Listen(uint16_t port);
+		static std::unique_ptr<Socket> Connect(const std::string& host, uint16_t port);
+		std::unique_ptr<Socket> Accept() const;
+
+		bool SendAll(const void* pData, size_t size) const;
+		bool ReceiveAll(void* pData, size_t size) const;
+
+		// Every packet starts with its type and payload size
+		bool SendPacket(uint32_t type, const std::vector<uint8_t>& payload) const;
+		bool ReceivePacket(uint32_t& type, std::vector<uint8_t>& payload) const;
+
+		SocketHandle GetHandle() const { return m_Handle; }
+
+		// Waits until at least one of the sockets has data, returns their indices
+		static std::vector<size_t> WaitForReadable(const std::vector<const Socket*>& sockets);
+
+	private:
+		Socket(SocketHandle handle);
+
+		SocketHandle m_Handle;
+	};
+}
@@ -6,8 +6,12 @@
 #include "Renderer.h"
 
 #include <algorithm>
+#include <chrono>
 #include <execution>
 #include <format>
+#include <immintrin.h>
+#include <iostream>
+#include <numeric>
 
 #include "Math.h"
 #include "Matrix.h"
@@ -28,70 +32,297 @@ Renderer::Renderer(SDL_Window * pWindow) :
 {
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
-	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	Initialize();
+}
 
-	m_YVals.reserve(m_Height);
-	for (uint16_t y{}; y < m_Height; ++y)
-		m_YVals.push_back(y);
+Renderer::Renderer(int width, int height) :
+	m_pBuffer(SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888)),
+	m_OwnsBuffer(true),
+	m_Width(width),
+	m_Height(height)
+{
+	// Too large or empty sizes, the renderer is left without a buffer
+	if (m_pBuffer == nullptr || width <= 0 || height <= 0)
+	{
+		SDL_FreeSurface(m_pBuffer);
+		m_pBuffer = nullptr;
+		std::cout << std::format("Could not create a {}x{} buffer: {}", width, height, SDL_GetError()) << std::endl;
+		m_Width = 0;
+		m_Height = 0;
+	}
+
+	Initialize();
 }
 
+Renderer::~Renderer()
+{
+	if (m_OwnsBuffer)
+		SDL_FreeSurface(m_pBuffer);
+}
+
+void Renderer::Initialize()
+{
+	m_pBufferPixels = m_pBuffer ? static_cast<uint32_t*>(m_pBuffer->pixels) : nullptr;
+
+	m_TileCountX = (m_Width + TILE_SIZE - 1) / TILE_SIZE;
+	m_TileCountY = (m_Height + TILE_SIZE - 1) / TILE_SIZE;
+
+	m_TileIndices.resize(static_cast<size_t>(m_TileCountX) * m_TileCountY);
+	std::iota(m_TileIndices.begin(), m_TileIndices.end(), 0);
 
+	m_GBuffer.resize(static_cast<size_t>(m_Width) * m_Height);
+
+	m_ColorR.resize(m_GBuffer.size());
+	m_ColorG.resize(m_GBuffer.size());
+	m_ColorB.resize(m_GBuffer.size());
+
+	m_RayDirectionX.resize(m_GBuffer.size());
+	m_RayDirectionY.resize(m_GBuffer.size());
+	m_RayDirectionZ.resize(m_GBuffer.size());
+}
 
 
 void Renderer::Render(Scene* scenePtr)
 {
-	Camera& camera = scenePtr->GetCamera();
-	const auto& materials = scenePtr->GetMaterials();
-	const auto& lights = scenePtr->GetLights();
+	const auto traceStartTime{ std::chrono::high_resolution_clock::now() };
+
+	PrepareFrame(scenePtr);
+	RenderTiles(m_TileIndices);
 
+	const auto traceEndTime{ std::chrono::high_resolution_clock::now() };
+
+	// Denoising needs the neighbours of every pixel, so it can only start when all tiles are traced
+	if (m_DenoiseEnabled)
+	{
+		m_pDenoiser->Denoise();
+
+		std::for_each(std::execution::par, m_TileIndices.begin(), m_TileIndices.end(), [this](const uint32_t tileIndex)
+			{
+				ResolveDenoisedTile(tileIndex);
+			});
+	}
+
+	const auto denoiseEndTime{ std::chrono::high_resolution_clock::now() };
+	m_TraceTime = std::chrono::duration<float, std::milli>(traceEndTime - traceStartTime).count();
+	m_DenoiseTime = std::chrono::duration<float, std::milli>(denoiseEndTime - traceEndTime).count();
+
+	Present();
+}
+
+void Renderer::PrepareFrame(Scene* scenePtr)
+{
+	PrepareFrame(scenePtr, scenePtr->GetCamera());
+}
+
+void Renderer::PrepareFrame(const Scene* scenePtr, Camera& camera)
+{
 	const float widthFloat{ static_cast<float>(m_Width) };
 	const float heightFloat{ static_cast<float>(m_Height) };
-	const float multiplierXValue{ 2.0f / widthFloat };
-	const float multiplierYValue{ 2.0f / heightFloat };
 	const float aspectRatio = widthFloat / heightFloat;
-	const float fieldOfViewTimesAspect{ aspectRatio * camera.fovValue };
 
-	const Matrix cameraToWorld{ camera.CalculateCameraToWorld() };
+	FrameContext& context{ m_FrameContext };
+	context.scenePtr = scenePtr;
+	context.cameraOrigin = camera.origin;
+	context.cameraToWorld = camera.CalculateCameraToWorld();
+	context.fovValue = camera.fovValue;
+	context.fieldOfViewTimesAspect = aspectRatio * camera.fovValue;
+	context.multiplierXValue = 2.0f / widthFloat;
+	context.multiplierYValue = 2.0f / heightFloat;
+	context.lights = scenePtr->GetLights();
+	context.materials = scenePtr->GetMaterials();
+
+	m_PixelResolver.SetFormat(m_pBuffer->format);
+
+	const Vector3 right{ context.cameraToWorld.GetAxisX() };
+	const Vector3 up{ context.cameraToWorld.GetAxisY() };
+	const Vector3 forward{ context.cameraToWorld.GetAxisZ() };
+
+	const auto areEqual = [](const Vector3& a, const Vector3& b)
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	};
+
+	// Ray directions only have to be made again when the camera rotated or zoomed
+	if (!m_HasRayTable || context.fovValue != m_RayTableFov ||
+		!areEqual(right, m_RayTableRight) || !areEqual(up, m_RayTableUp) || !areEqual(forward, m_RayTableForward))
+	{
+		std::for_each(std::execution::par, m_TileIndices.begin(), m_TileIndices.end(), [this, &context](const uint32_t tileIndex)
+			{
+				BuildRayTableTile(context, tileIndex);
+			});
+
+		m_RayTableRight = right;
+		m_RayTableUp = up;
+		m_RayTableForward = forward;
+		m_RayTableFov = context.fovValue;
+		m_HasRayTable = true;
+	}
+
+	// Find out which pixels have to be traced or shaded again
+	context.changes = DetectChanges(scenePtr, camera, context.cameraToWorld);
+
+	// Indirect light reaches every pixel, so old records and old pixels are both wrong
+	if (m_pIrradianceCache && context.changes.sceneChanged)
+	{
+		m_pIrradianceCache->Clear();
+		context.changes.reshadeAll = context.changes.reshadeAll || m_IrradianceEnabled;
+	}
 
 #ifdef INTERLACED
 		interlaceState++;
 		if (interlaceState >= interlaceSpace)
 			interlaceState = 0;
 #endif
+}
 
+void Renderer::RenderTiles(const std::vector<uint32_t>& tileIndices)
+{
 #ifdef MULTI
-	// We run a for_each for each of the y pixels, this will be distributed over all cpu threads
-	std::for_each(std::execution::par, m_YVals.begin(), m_YVals.end(), [this, camera, multiplierXValue, multiplierYValue, fieldOfViewTimesAspect, cameraToWorld, scenePtr, lights, materials](const uint16_t pixelY)
+	// We run a for_each for each of the tiles, this will be distributed over all cpu threads
+	std::for_each(std::execution::par, tileIndices.begin(), tileIndices.end(), [this](const uint32_t tileIndex)
 		{
+			RenderTile(m_FrameContext, tileIndex);
+		});
 #else
-	for (int pixelY{}; pixelY < m_Height; ++pixelY)
-	{
+	for (const uint32_t tileIndex : tileIndices)
+		RenderTile(m_FrameContext, tileIndex);
 #endif
-		Vector3 rayDirection{ 0,0,1 };
+}
+
+void Renderer::Present() const
+{
+	//Update SDL Surface
+	if (m_pWindow)
+		SDL_UpdateWindowSurface(m_pWindow);
+}
 
-		rayDirection.y = (1.0f - (static_cast<float>(pixelY) + 0.5f) * multiplierYValue) * camera.fovValue;
+void Renderer::ReadTile(uint32_t tileIndex, std::vector<uint32_t>& pixels) const
+{
+	const int tileMinX{ static_cast<int>(tileIndex) % m_TileCountX * TILE_SIZE };
+	const int tileMinY{ static_cast<int>(tileIndex) / m_TileCountX * TILE_SIZE };
+	const int tileMaxX{ std::min(tileMinX + TILE_SIZE, m_Width) };
+	const int tileMaxY{ std::min(tileMinY + TILE_SIZE, m_Height) };
 
-#ifdef INTERLACED
+	pixels.clear();
+	pixels.reserve(static_cast<size_t>(tileMaxX - tileMinX) * (tileMaxY - tileMinY));
 
-		for (int pixelX{ interlaceState }; pixelX < m_Width; pixelX += interlaceSpace)
+	for (int pixelY{ tileMinY }; pixelY < tileMaxY; ++pixelY)
+	{
+		for (int pixelX{ tileMinX }; pixelX < tileMaxX; ++pixelX)
 		{
-#else
-		for (int pixelX{0}; pixelX < m_Width; pixelX++)
+			uint8_t r{}, g{}, b{};
+			SDL_GetRGB(m_pBufferPixels[pixelX + pixelY * m_Width], m_pBuffer->format, &r, &g, &b);
+
+			pixels.push_back(static_cast<uint32_t>(r) << 16 | static_cast<uint32_t>(g) << 8 | b);
+		}
+	}
+}
+
+bool Renderer::WriteTile(uint32_t tileIndex, const std::vector<uint32_t>& pixels)
+{
+	if (tileIndex >= m_TileIndices.size())
+		return false;
+
+	const int tileMinX{ static_cast<int>(tileIndex) % m_TileCountX * TILE_SIZE };
+	const int tileMinY{ static_cast<int>(tileIndex) / m_TileCountX * TILE_SIZE };
+	const int tileMaxX{ std::min(tileMinX + TILE_SIZE, m_Width) };
+	const int tileMaxY{ std::min(tileMinY + TILE_SIZE, m_Height) };
+
+	if (pixels.size() != static_cast<size_t>(tileMaxX - tileMinX) * (tileMaxY - tileMinY))
+		return false;
+
+	// Workers resolved the colors already, only the channel order of this buffer is left
+	m_PixelResolver.SetFormat(m_pBuffer->format);
+
+	const int tileWidth{ tileMaxX - tileMinX };
+	for (int pixelY{ tileMinY }; pixelY < tileMaxY; ++pixelY)
+		m_PixelResolver.PackRow(&pixels[static_cast<size_t>(pixelY - tileMinY) * tileWidth], &m_pBufferPixels[tileMinX + pixelY * m_Width], tileWidth);
+
+	return true;
+}
+
+void Renderer::RenderTile(const FrameContext& context, uint32_t tileIndex)
+{
+	const Scene* scenePtr{ context.scenePtr };
+	const auto& lights = context.lights;
+	const auto& materials = context.materials;
+	const FrameChanges& changes{ context.changes };
+
+	const int tileMinX{ static_cast<int>(tileIndex) % m_TileCountX * TILE_SIZE };
+	const int tileMinY{ static_cast<int>(tileIndex) / m_TileCountX * TILE_SIZE };
+	const int tileMaxX{ std::min(tileMinX + TILE_SIZE, m_Width) };
+	const int tileMaxY{ std::min(tileMinY + TILE_SIZE, m_Height) };
+
+	// Only built once the first primary ray of this tile has to be traced
+	GeometryCandidates candidates{};
+	bool hasCandidates{ false };
+
+	for (int pixelY{ tileMinY }; pixelY < tileMaxY; ++pixelY)
+	{
+		for (int pixelX{ tileMinX }; pixelX < tileMaxX; pixelX++)
 		{
+#ifdef INTERLACED
+			if (pixelX % interlaceSpace != interlaceState)
+				continue;
 #endif
-			rayDirection.x = ((static_cast<float>(pixelX) + 0.5f) * multiplierXValue - 1.0f) * fieldOfViewTimesAspect;
-
 			//=====================FOR EVERY PIXEL===============================
 
+			const int pixelIndex{ pixelX + pixelY * m_Width };
+			GBufferSample& sample{ m_GBuffer[pixelIndex] };
+
+			const PixelState pixelState{ changes.retraceAll ? PixelState::Retrace : GetPixelState(sample, pixelX, pixelY, changes, lights) };
+
+			// Keep the color of last frame
+			if (pixelState == PixelState::Clean)
+				continue;
+
 			ColorRGB finalColor{};
 
 			// Setup view ray
 			Ray viewRay
 			{
-				camera.origin,
-				cameraToWorld.TransformVector(rayDirection.Normalized())
+				context.cameraOrigin,
+				{ m_RayDirectionX[pixelIndex], m_RayDirectionY[pixelIndex], m_RayDirectionZ[pixelIndex] }
 			};
 
+			// The primary hit only gets traced when it could have changed, otherwise it comes from the G-buffer
+			HitRecord closestHit{};
+			if (pixelState == PixelState::Retrace)
+			{
+				// Cached shadows belong to the old hit point
+				sample.lightVisibilityValid = 0;
+
+				if (!hasCandidates)
+				{
+					scenePtr->GetCandidates(BuildTileFrustum(context, tileMinX, tileMinY, tileMaxX, tileMaxY), candidates);
+					hasCandidates = true;
+				}
+
+				scenePtr->GetClosestHit(viewRay, closestHit, candidates);
+
+				sample.point = closestHit.point;
+				sample.normal = closestHit.normal;
+				sample.t = closestHit.t;
+				sample.primitiveId = closestHit.primitiveId;
+				sample.materialIndex = closestHit.materialIndex;
+				sample.didHit = closestHit.didHit;
+			}
+			else
+			{
+				closestHit.point = sample.point;
+				closestHit.normal = sample.normal;
+				closestHit.t = sample.t;
+				closestHit.primitiveId = sample.primitiveId;
+				closestHit.materialIndex = sample.materialIndex;
+				closestHit.didHit = sample.didHit;
+			}
+
+			const ColorRGB albedo{ closestHit.didHit ? materials[closestHit.materialIndex]->GetAlbedo() : colors::White };
+
+			sample.bounceMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+			sample.bounceMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			sample.bounceEscaped = false;
+
 #ifdef REFLECT
 			float colorLeft{ 1.0f };
 
@@ -100,9 +331,34 @@ void Renderer::Render(Scene* scenePtr)
 				//=====================FOR EVERY BOUNCE===============================
 				if(colorLeft < EPSILON)
 					break;
+
+				if (bounceIndex > 0)
+				{
+					closestHit = {};
+					scenePtr->GetClosestHit(viewRay, closestHit);
+
+					// Remember what the bounce touched, anything moving in there invalidates the pixel
+					if (closestHit.didHit)
+					{
+						sample.bounceMin = Vector3::Min(sample.bounceMin, closestHit.point);
+						sample.bounceMax = Vector3::Max(sample.bounceMax, closestHit.point);
+
+						for (const Light& light : lights)
+						{
+							sample.bounceMin = Vector3::Min(sample.bounceMin, light.origin);
+							sample.bounceMax = Vector3::Max(sample.bounceMax, light.origin);
+						}
+					}
+					else
+					{
+						sample.bounceEscaped = true;
+					}
+				}
+
+				const bool isPrimaryHit{ bounceIndex == 0 };
+#else
+				const bool isPrimaryHit{ true };
 #endif
-				HitRecord closestHit{};
-				scenePtr->GetClosestHit(viewRay, closestHit);
 
 				Material* hitMaterial{ materials[closestHit.materialIndex] };
 
@@ -118,15 +374,16 @@ void Renderer::Render(Scene* scenePtr)
 
 				if (closestHit.didHit)
 				{
-					for (const Light& light : lights)
+					for (size_t lightIndex{}; lightIndex < lights.size(); ++lightIndex)
 					{
+						const Light& light{ lights[lightIndex] };
 						const Vector3 lightToHitDirection{ hitPointWithOffset - light.origin };
 						const float lightToHitDistance{ lightToHitDirection.Magnitude() };
 						const Vector3 l = lightToHitDirection / lightToHitDistance;
 
 						const Ray hitToLightRay{ light.origin, l,0.0f,lightToHitDistance };
 
-						if (m_ShadowsEnabled && scenePtr->DoesHit(hitToLightRay))
+						if (m_ShadowsEnabled && !IsLightVisible(sample, isPrimaryHit, lightIndex, hitToLightRay, context))
 							continue;
 
 						const float cosineLaw = std::max(0.0f, Vector3::Dot(closestHit.normal, -l));
@@ -160,6 +417,19 @@ void Renderer::Render(Scene* scenePtr)
 						}
 
 					}
+
+					// Diffuse light bounced off the surroundings, only for the primary hit since it is the most visible
+					if (m_IrradianceEnabled && isPrimaryHit && m_CurrentLightMode == LightMode::Combined)
+					{
+						const ColorRGB irradiance{ m_pIrradianceCache->GetIrradiance(closestHit.point, closestHit.normal, *scenePtr, lights, materials, m_ShadowsEnabled) };
+
+						finalColor += hitMaterial->GetAlbedo() * irradiance / PI
+#ifdef REFLECT
+							* currentColor;
+#else
+							;
+#endif
+					}
 				}
 #ifdef REFLECT
 
@@ -171,32 +441,409 @@ void Renderer::Render(Scene* scenePtr)
 			}
 #endif
 
+			// The denoiser writes the screen once every tile is traced
+			if (m_DenoiseEnabled)
+			{
+				m_pDenoiser->SetSample(pixelIndex, finalColor, albedo, sample.didHit ? sample.normal : Vector3{}, sample.t);
+				continue;
+			}
+
+			m_ColorR[pixelIndex] = finalColor.r;
+			m_ColorG[pixelIndex] = finalColor.g;
+			m_ColorB[pixelIndex] = finalColor.b;
 
-			finalColor.MaxToOne();
+			//=====================FOR EVERY PIXEL===============================
+		}
+	}
 
-			m_pBufferPixels[pixelX + pixelY * m_Width] = SDL_MapRGB(m_pBuffer->format,
-				static_cast<uint8_t>(finalColor.r * 255),
-				static_cast<uint8_t>(finalColor.g * 255),
-				static_cast<uint8_t>(finalColor.b * 255));
+	if (!m_DenoiseEnabled)
+		ResolveTile(tileIndex);
+}
 
+void Renderer::BuildRayTableTile(const FrameContext& context, uint32_t tileIndex)
+{
+	const int tileMinX{ static_cast<int>(tileIndex) % m_TileCountX * TILE_SIZE };
+	const int tileMinY{ static_cast<int>(tileIndex) / m_TileCountX * TILE_SIZE };
+	const int tileMaxX{ std::min(tileMinX + TILE_SIZE, m_Width) };
+	const int tileMaxY{ std::min(tileMinY + TILE_SIZE, m_Height) };
 
-			//=====================FOR EVERY PIXEL===============================
+	const Vector3 right{ context.cameraToWorld.GetAxisX() };
+	const Vector3 up{ context.cameraToWorld.GetAxisY() };
+	const Vector3 forward{ context.cameraToWorld.GetAxisZ() };
+
+	// Used for the pixels left over after the groups of four, (x, y, 1) normalized and rotated to world space
+	const auto transformDirection = [&](float cameraX, float cameraY, int pixelIndex)
+	{
+		const float inverseLength{ 1.0f / std::sqrt(cameraX * cameraX + cameraY * cameraY + 1.0f) };
+		const Vector3 direction{ (right * cameraX + up * cameraY + forward) * inverseLength };
+
+		m_RayDirectionX[pixelIndex] = direction.x;
+		m_RayDirectionY[pixelIndex] = direction.y;
+		m_RayDirectionZ[pixelIndex] = direction.z;
+	};
+
+	const __m128 rightX{ _mm_set1_ps(right.x) }, rightY{ _mm_set1_ps(right.y) }, rightZ{ _mm_set1_ps(right.z) };
+	const __m128 upX{ _mm_set1_ps(up.x) }, upY{ _mm_set1_ps(up.y) }, upZ{ _mm_set1_ps(up.z) };
+	const __m128 forwardX{ _mm_set1_ps(forward.x) }, forwardY{ _mm_set1_ps(forward.y) }, forwardZ{ _mm_set1_ps(forward.z) };
+
+	const __m128 pixelOffsets{ _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f) };
+	const __m128 multiplierX{ _mm_set1_ps(context.multiplierXValue) };
+	const __m128 fieldOfViewTimesAspect{ _mm_set1_ps(context.fieldOfViewTimesAspect) };
+	const __m128 one{ _mm_set1_ps(1.0f) };
+
+	for (int pixelY{ tileMinY }; pixelY < tileMaxY; ++pixelY)
+	{
+		const float cameraY{ (1.0f - (static_cast<float>(pixelY) + 0.5f) * context.multiplierYValue) * context.fovValue };
+		const __m128 cameraYs{ _mm_set1_ps(cameraY) };
+		const __m128 cameraYSquared{ _mm_mul_ps(cameraYs, cameraYs) };
+
+		int pixelX{ tileMinX };
+		for (; pixelX + 4 <= tileMaxX; pixelX += 4)
+		{
+			const __m128 screenX{ _mm_add_ps(_mm_set1_ps(static_cast<float>(pixelX)), pixelOffsets) };
+			const __m128 cameraX{ _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(screenX, multiplierX), one), fieldOfViewTimesAspect) };
+
+			const __m128 inverseLength{ _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cameraX, cameraX), cameraYSquared), one))) };
+			const __m128 directionX{ _mm_mul_ps(cameraX, inverseLength) };
+			const __m128 directionY{ _mm_mul_ps(cameraYs, inverseLength) };
+
+			const int pixelIndex{ pixelX + pixelY * m_Width };
+			_mm_storeu_ps(&m_RayDirectionX[pixelIndex], _mm_add_ps(_mm_add_ps(_mm_mul_ps(rightX, directionX), _mm_mul_ps(upX, directionY)), _mm_mul_ps(forwardX, inverseLength)));
+			_mm_storeu_ps(&m_RayDirectionY[pixelIndex], _mm_add_ps(_mm_add_ps(_mm_mul_ps(rightY, directionX), _mm_mul_ps(upY, directionY)), _mm_mul_ps(forwardY, inverseLength)));
+			_mm_storeu_ps(&m_RayDirectionZ[pixelIndex], _mm_add_ps(_mm_add_ps(_mm_mul_ps(rightZ, directionX), _mm_mul_ps(upZ, directionY)), _mm_mul_ps(forwardZ, inverseLength)));
 		}
 
-#ifdef MULTI
-	});
-#else
-			}
-#endif
+		// Tiles at the edge of the screen can be narrower than a multiple of four
+		for (; pixelX < tileMaxX; ++pixelX)
+		{
+			const float cameraX{ ((static_cast<float>(pixelX) + 0.5f) * context.multiplierXValue - 1.0f) * context.fieldOfViewTimesAspect };
+			transformDirection(cameraX, cameraY, pixelX + pixelY * m_Width);
+		}
+	}
+}
 
-	
-	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+void Renderer::ResolveDenoisedTile(uint32_t tileIndex)
+{
+	const int tileMinX{ static_cast<int>(tileIndex) % m_TileCountX * TILE_SIZE };
+	const int tileMinY{ static_cast<int>(tileIndex) / m_TileCountX * TILE_SIZE };
+	const int tileMaxX{ std::min(tileMinX + TILE_SIZE, m_Width) };
+	const int tileMaxY{ std::min(tileMinY + TILE_SIZE, m_Height) };
+
+	for (int pixelY{ tileMinY }; pixelY < tileMaxY; ++pixelY)
+	{
+		for (int pixelX{ tileMinX }; pixelX < tileMaxX; ++pixelX)
+		{
+			const int pixelIndex{ pixelX + pixelY * m_Width };
+			const ColorRGB denoisedColor{ m_pDenoiser->GetColor(pixelIndex) };
+
+			m_ColorR[pixelIndex] = denoisedColor.r;
+			m_ColorG[pixelIndex] = denoisedColor.g;
+			m_ColorB[pixelIndex] = denoisedColor.b;
+		}
+	}
+
+	ResolveTile(tileIndex);
+}
+
+void Renderer::ResolveTile(uint32_t tileIndex)
+{
+	const int tileMinX{ static_cast<int>(tileIndex) % m_TileCountX * TILE_SIZE };
+	const int tileMinY{ static_cast<int>(tileIndex) / m_TileCountX * TILE_SIZE };
+	const int tileMaxX{ std::min(tileMinX + TILE_SIZE, m_Width) };
+	const int tileMaxY{ std::min(tileMinY + TILE_SIZE, m_Height) };
+
+	// Rows of a tile are next to each other in every buffer, so every row is resolved in one go
+	for (int pixelY{ tileMinY }; pixelY < tileMaxY; ++pixelY)
+	{
+		const int rowStart{ tileMinX + pixelY * m_Width };
+		m_PixelResolver.ResolveRow(&m_ColorR[rowStart], &m_ColorG[rowStart], &m_ColorB[rowStart], &m_pBufferPixels[rowStart], tileMaxX - tileMinX);
+	}
+}
+
+Frustum Renderer::BuildTileFrustum(const FrameContext& context, int minX, int minY, int maxX, int maxY) const
+{
+	// Same mapping as the view rays, but on the pixel edges so the whole tile is covered
+	const auto getDirection = [&context](int screenX, int screenY)
+	{
+		const Vector3 direction
+		{
+			(static_cast<float>(screenX) * context.multiplierXValue - 1.0f) * context.fieldOfViewTimesAspect,
+			(1.0f - static_cast<float>(screenY) * context.multiplierYValue) * context.fovValue,
+			1.0f
+		};
+
+		return context.cameraToWorld.TransformVector(direction);
+	};
+
+	const Vector3 corners[4]
+	{
+		getDirection(minX, minY),
+		getDirection(maxX, minY),
+		getDirection(maxX, maxY),
+		getDirection(minX, maxY)
+	};
+
+	const Vector3 center{ corners[0] + corners[1] + corners[2] + corners[3] };
+
+	Frustum frustum{};
+	frustum.origin = context.cameraOrigin;
+
+	for (int i{}; i < 4; ++i)
+	{
+		Vector3 normal{ Vector3::Cross(corners[i], corners[(i + 1) % 4]).Normalized() };
+
+		// Make sure the plane faces the inside of the tile
+		if (Vector3::Dot(normal, center) < 0.0f)
+			normal = -normal;
+
+		frustum.normals[i] = normal;
+	}
+
+	return frustum;
+}
+
+Renderer::FrameChanges Renderer::DetectChanges(const Scene* scenePtr, const Camera& camera, const Matrix& cameraToWorld)
+{
+	const auto& lights = scenePtr->GetLights();
+	const auto& spheres = scenePtr->GetSphereGeometries();
+	const auto& meshes = scenePtr->GetTriangleMeshGeometries();
+
+	const auto areEqual = [](const Vector3& a, const Vector3& b)
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	};
+
+	const auto areLightsEqual = [&areEqual](const Light& a, const Light& b)
+	{
+		return areEqual(a.origin, b.origin) && areEqual(a.direction, b.direction) && a.type == b.type &&
+			a.color.r == b.color.r && a.color.g == b.color.g && a.color.b == b.color.b && a.intensity == b.intensity;
+	};
+
+	const auto areObjectsEqual = [&areEqual](const ObjectState& a, const ObjectState& b)
+	{
+		return a.version == b.version && areEqual(a.min, b.min) && areEqual(a.max, b.max);
+	};
+
+	// Collect the state of everything that can change between frames
+	FrameState currentFrame{ scenePtr->GetGeneration(), camera.origin, camera.forward, camera.fovValue, m_CurrentLightMode, m_ShadowsEnabled, lights, {} };
+	currentFrame.objects.reserve(spheres.size() + meshes.size());
+
+	for (const Sphere& sphere : spheres)
+	{
+		const Vector3 extent{ sphere.radius, sphere.radius, sphere.radius };
+		currentFrame.objects.push_back({ sphere.origin - extent, sphere.origin + extent, 0 });
+	}
+
+	for (const TriangleMesh& mesh : meshes)
+		currentFrame.objects.push_back({ mesh.transformedMinAABB, mesh.transformedMaxAABB, mesh.transformVersion });
+
+
+	FrameChanges changes{};
+
+	const bool isSameScene
+	{
+		currentFrame.sceneGeneration == m_PreviousFrame.sceneGeneration &&
+		currentFrame.lights.size() == m_PreviousFrame.lights.size() &&
+		currentFrame.objects.size() == m_PreviousFrame.objects.size()
+	};
+
+	changes.sceneChanged = !isSameScene ||
+		!std::equal(currentFrame.lights.begin(), currentFrame.lights.end(), m_PreviousFrame.lights.begin(), areLightsEqual) ||
+		!std::equal(currentFrame.objects.begin(), currentFrame.objects.end(), m_PreviousFrame.objects.begin(), areObjectsEqual);
+
+	const bool canReuse
+	{
+		m_IncrementalEnabled && m_HasPreviousFrame && isSameScene &&
+		areEqual(currentFrame.cameraOrigin, m_PreviousFrame.cameraOrigin) &&
+		areEqual(currentFrame.cameraForward, m_PreviousFrame.cameraForward) &&
+		currentFrame.cameraFov == m_PreviousFrame.cameraFov
+	};
+
+	if (canReuse)
+	{
+		changes.retraceAll = false;
+		changes.reshadeAll = currentFrame.lightMode != m_PreviousFrame.lightMode || currentFrame.shadowsEnabled != m_PreviousFrame.shadowsEnabled;
+
+		// Any light change means every pixel has to be shaded again, the primary hits stay valid
+		for (size_t i{}; i < lights.size(); ++i)
+		{
+			const Light& current{ currentFrame.lights[i] };
+			const Light& previous{ m_PreviousFrame.lights[i] };
+
+			const bool hasMoved
+			{
+				!areEqual(current.origin, previous.origin) ||
+				!areEqual(current.direction, previous.direction) ||
+				current.type != previous.type
+			};
+
+			// Only lights that moved lose their cached shadows, a new color or intensity keeps them
+			if (hasMoved && i < MAX_CACHED_LIGHTS)
+				changes.movedLights |= uint64_t{ 1 } << i;
+
+			changes.reshadeAll = changes.reshadeAll || !areLightsEqual(current, previous);
+		}
+
+		// Without shadows nothing keeps the cached visibility up to date, lights and objects could have moved meanwhile
+		if (currentFrame.shadowsEnabled && !m_PreviousFrame.shadowsEnabled)
+			changes.movedLights = ~uint64_t{ 0 };
+
+		// Moving objects invalidate the area they left and the area they moved into
+		for (size_t i{}; i < currentFrame.objects.size(); ++i)
+		{
+			const ObjectState& current{ currentFrame.objects[i] };
+			const ObjectState& previous{ m_PreviousFrame.objects[i] };
+
+			if (areObjectsEqual(current, previous))
+				continue;
+
+			const Vector3 movedMin{ Vector3::Min(current.min, previous.min) };
+			const Vector3 movedMax{ Vector3::Max(current.max, previous.max) };
+
+			changes.movedMin.push_back(movedMin);
+			changes.movedMax.push_back(movedMax);
+			changes.movedRects.push_back(ProjectBounds(movedMin, movedMax, camera, cameraToWorld));
+		}
+	}
+
+	m_PreviousFrame = std::move(currentFrame);
+	m_HasPreviousFrame = true;
+
+	return changes;
+}
+
+Renderer::ScreenRect Renderer::ProjectBounds(const Vector3& min, const Vector3& max, const Camera& camera, const Matrix& cameraToWorld) const
+{
+	const ScreenRect fullScreen{ 0, 0, m_Width - 1, m_Height - 1 };
+
+	const float aspectRatio{ static_cast<float>(m_Width) / static_cast<float>(m_Height) };
+	const float fieldOfViewTimesAspect{ aspectRatio * camera.fovValue };
+
+	const Vector3 right{ cameraToWorld.GetAxisX() };
+	const Vector3 up{ cameraToWorld.GetAxisY() };
+	const Vector3 forward{ cameraToWorld.GetAxisZ() };
+
+	float screenMinX{ FLT_MAX };
+	float screenMinY{ FLT_MAX };
+	float screenMaxX{ -FLT_MAX };
+	float screenMaxY{ -FLT_MAX };
+
+	for (int corner{}; corner < 8; ++corner)
+	{
+		const Vector3 point
+		{
+			(corner & 1) ? max.x : min.x,
+			(corner & 2) ? max.y : min.y,
+			(corner & 4) ? max.z : min.z
+		};
+
+		const Vector3 toPoint{ point - camera.origin };
+		const float depth{ Vector3::Dot(toPoint, forward) };
+
+		// Bounds reaching behind the camera can cover any pixel
+		if (depth <= EPSILON)
+			return fullScreen;
+
+		// Inverse of the view ray setup in Render
+		const float ndcX{ Vector3::Dot(toPoint, right) / (depth * fieldOfViewTimesAspect) };
+		const float ndcY{ Vector3::Dot(toPoint, up) / (depth * camera.fovValue) };
+
+		const float screenX{ (ndcX + 1.0f) * 0.5f * static_cast<float>(m_Width) };
+		const float screenY{ (1.0f - ndcY) * 0.5f * static_cast<float>(m_Height) };
+
+		screenMinX = std::min(screenMinX, screenX);
+		screenMinY = std::min(screenMinY, screenY);
+		screenMaxX = std::max(screenMaxX, screenX);
+		screenMaxY = std::max(screenMaxY, screenY);
+	}
+
+	// One pixel of slack to be safe with rounding
+	return
+	{
+		std::clamp(static_cast<int>(std::floor(screenMinX)) - 1, 0, m_Width),
+		std::clamp(static_cast<int>(std::floor(screenMinY)) - 1, 0, m_Height),
+		std::clamp(static_cast<int>(std::ceil(screenMaxX)) + 1, -1, m_Width - 1),
+		std::clamp(static_cast<int>(std::ceil(screenMaxY)) + 1, -1, m_Height - 1)
+	};
+}
+
+bool Renderer::IsLightVisible(GBufferSample& sample, bool isPrimaryHit, size_t lightIndex, const Ray& hitToLightRay, const FrameContext& context) const
+{
+	// Only the shadows of the primary hit are kept, bounce hits are different every time they are traced
+	if (!isPrimaryHit || lightIndex >= MAX_CACHED_LIGHTS)
+		return !context.scenePtr->DoesHit(hitToLightRay);
+
+	const uint64_t lightBit{ uint64_t{ 1 } << lightIndex };
+	const FrameChanges& changes{ context.changes };
+
+	bool isCacheValid{ (sample.lightVisibilityValid & lightBit) != 0 && (changes.movedLights & lightBit) == 0 };
+
+	// Something that moved could now be in the way, or no longer be in the way
+	for (size_t i{}; i < changes.movedMin.size() && isCacheValid; ++i)
+		isCacheValid = !GeometryUtils::HitTest_AABB(changes.movedMin[i], changes.movedMax[i], hitToLightRay);
+
+	if (isCacheValid)
+		return (sample.lightVisibility & lightBit) != 0;
+
+	const bool isVisible{ !context.scenePtr->DoesHit(hitToLightRay) };
+
+	sample.lightVisibilityValid |= lightBit;
+	if (isVisible)
+		sample.lightVisibility |= lightBit;
+	else
+		sample.lightVisibility &= ~lightBit;
+
+	return isVisible;
+}
+
+Renderer::PixelState Renderer::GetPixelState(const GBufferSample& sample, int pixelX, int pixelY, const FrameChanges& changes, const std::vector<Light>& lights) const
+{
+	// Primary ray might see a moved object
+	for (const ScreenRect& rect : changes.movedRects)
+	{
+		if (pixelX >= rect.minX && pixelX <= rect.maxX && pixelY >= rect.minY && pixelY <= rect.maxY)
+			return PixelState::Retrace;
+	}
+
+	if (changes.reshadeAll)
+		return PixelState::Reshade;
+
+	for (size_t i{}; i < changes.movedMin.size(); ++i)
+	{
+		const Vector3& movedMin{ changes.movedMin[i] };
+		const Vector3& movedMax{ changes.movedMax[i] };
+
+		// Bounce rays might see a moved object
+		if (sample.bounceEscaped || GeometryUtils::Overlap_AABB(sample.bounceMin, sample.bounceMax, movedMin, movedMax))
+			return PixelState::Reshade;
+
+		if (!sample.didHit || !m_ShadowsEnabled)
+			continue;
+
+		// Shadow rays might be blocked or unblocked by a moved object
+		const Vector3 hitPointWithOffset{ sample.point + sample.normal * SHADOW_NORMAL_OFFSET };
+		for (const Light& light : lights)
+		{
+			const Vector3 lightToHitDirection{ hitPointWithOffset - light.origin };
+			const float lightToHitDistance{ lightToHitDirection.Magnitude() };
+			const Ray hitToLightRay{ light.origin, lightToHitDirection / lightToHitDistance, 0.0f, lightToHitDistance };
+
+			if (GeometryUtils::HitTest_AABB(movedMin, movedMax, hitToLightRay))
+				return PixelState::Reshade;
+		}
+	}
+
+	return PixelState::Clean;
 }
 
 bool Renderer::SaveBufferToImage() const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	return SaveBufferToImage("RayTracing_Buffer.bmp");
+}
+
+bool Renderer::SaveBufferToImage(const std::string& filePath) const
+{
+	return SDL_SaveBMP(m_pBuffer, filePath.c_str());
 }
 
 void Renderer::ToggleShadows()
@@ -204,6 +851,12 @@ void Renderer::ToggleShadows()
 	m_ShadowsEnabled = !m_ShadowsEnabled;
 }
 
+void Renderer::SetLightMode(int lightMode)
+{
+	if (lightMode >= 0 && lightMode < static_cast<int>(LightMode::COUNT))
+		m_CurrentLightMode = static_cast<LightMode>(lightMode);
+}
+
 void Renderer::CycleLightMode()
 {
 	int current{ static_cast<int>(m_CurrentLightMode) };
@@ -218,4 +871,62 @@ void Renderer::CycleLightMode()
 	std::cout << std::format("Current light mode {}", LIGHT_MODE_NAMES.at((int)m_CurrentLightMode)) << std::endl;
 	std::cout << std::endl;
 }
-	
\ No newline at end of file
+
+void Renderer::ToggleIncremental()
+{
+	m_IncrementalEnabled = !m_IncrementalEnabled;
+
+	std::cout << std::endl;
+	std::cout << std::format("Incremental rendering {}", m_IncrementalEnabled ? "enabled" : "disabled") << std::endl;
+	std::cout << std::endl;
+}
+
+void Renderer::ToggleDenoiser()
+{
+	m_DenoiseEnabled = !m_DenoiseEnabled;
+
+	// Only made when it is used, its buffers are as big as a few copies of the screen
+	if (m_DenoiseEnabled && !m_pDenoiser)
+		m_pDenoiser = std::make_unique<Denoiser>(m_Width, m_Height, TILE_SIZE);
+
+	// Pixels that are not traced again never gave their color to the denoiser, so start over
+	m_HasPreviousFrame = false;
+
+	std::cout << std::endl;
+	std::cout << std::format("Denoiser {}", m_DenoiseEnabled ? "enabled" : "disabled") << std::endl;
+	std::cout << std::endl;
+}
+
+void Renderer::ToggleIrradianceCache()
+{
+	m_IrradianceEnabled = !m_IrradianceEnabled;
+
+	// Kept when turned off, the records stay valid as long as the scene does not change
+	if (m_IrradianceEnabled && !m_pIrradianceCache)
+		m_pIrradianceCache = std::make_unique<IrradianceCache>();
+
+	// Pixels that are not shaded again would keep their old indirect light
+	m_HasPreviousFrame = false;
+
+	std::cout << std::endl;
+	std::cout << std::format("Irradiance cache {}", m_IrradianceEnabled ? "enabled" : "disabled") << std::endl;
+	std::cout << std::endl;
+}
+
+void Renderer::ToggleToneMapping()
+{
+	m_PixelResolver.ToggleToneMapping();
+
+	std::cout << std::endl;
+	std::cout << std::format("Tone mapping {}", m_PixelResolver.IsToneMappingEnabled() ? "enabled" : "disabled") << std::endl;
+	std::cout << std::endl;
+}
+
+void Renderer::ToggleGammaCorrection()
+{
+	m_PixelResolver.ToggleGammaCorrection();
+
+	std::cout << std::endl;
+	std::cout << std::format("Gamma correction {}", m_PixelResolver.IsGammaCorrectionEnabled() ? "enabled" : "disabled") << std::endl;
+	std::cout << std::endl;
+}
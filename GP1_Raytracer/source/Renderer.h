@@ -2,9 +2,15 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "DataTypes.h"
+#include "Denoiser.h"
+#include "IrradianceCache.h"
+#include "PixelResolver.h"
+
 struct SDL_Window;
 struct SDL_Surface;
 
@@ -13,13 +19,18 @@ constexpr int maxBounces{ 5 };
 namespace dae
 {
 	class Scene;
+	class Material;
+	struct Camera;
 	struct ColorRGB;
 
 	class Renderer final
 	{
 	public:
 		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+
+		// Renders into its own buffer without a window, used by render workers
+		Renderer(int width, int height);
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
@@ -27,24 +38,46 @@ namespace dae
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
 		void Render(Scene* scenePtr);
-		bool SaveBufferToImage() const;
-		void ToggleShadows();
-		void CycleLightMode();
-
-	private:
 
+		// Render split in steps, so tiles can be rendered by another process and copied in
+		void PrepareFrame(Scene* scenePtr);
+		void PrepareFrame(const Scene* scenePtr, Camera& camera);
+		void RenderTiles(const std::vector<uint32_t>& tileIndices);
+		void Present() const;
 
-		SDL_Window* m_pWindow{};
+		// Tile pixels are row by row in 0x00RRGGBB, independent of the buffer format
+		void ReadTile(uint32_t tileIndex, std::vector<uint32_t>& pixels) const;
+		bool WriteTile(uint32_t tileIndex, const std::vector<uint32_t>& pixels);
+		uint32_t GetTileCount() const { return static_cast<uint32_t>(m_TileIndices.size()); }
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
 
-		SDL_Surface* m_pBuffer{};
-		uint32_t* m_pBufferPixels{};
-
-		int m_Width{};
-		int m_Height{};
+		// False when the buffer of a renderer without a window could not be made, nothing can be rendered then
+		bool HasBuffer() const { return m_pBuffer != nullptr; }
+		bool SaveBufferToImage() const;
+		bool SaveBufferToImage(const std::string& filePath) const;
+		void ToggleShadows();
+		bool AreShadowsEnabled() const { return m_ShadowsEnabled; }
+		void SetShadowsEnabled(bool enabled) { m_ShadowsEnabled = enabled; }
+		int GetLightMode() const { return static_cast<int>(m_CurrentLightMode); }
+		void SetLightMode(int lightMode);
+		void CycleLightMode();
+		void ToggleIncremental();
+		void SetIncrementalEnabled(bool enabled) { m_IncrementalEnabled = enabled; }
+		void ToggleDenoiser();
+		void ToggleIrradianceCache();
+		void ToggleToneMapping();
+		void ToggleGammaCorrection();
+		bool IsToneMappingEnabled() const { return m_PixelResolver.IsToneMappingEnabled(); }
+		void SetToneMappingEnabled(bool enabled) { m_PixelResolver.SetToneMappingEnabled(enabled); }
+		bool IsGammaCorrectionEnabled() const { return m_PixelResolver.IsGammaCorrectionEnabled(); }
+		void SetGammaCorrectionEnabled(bool enabled) { m_PixelResolver.SetGammaCorrectionEnabled(enabled); }
 
-		const float SHADOW_NORMAL_OFFSET{ 0.001f };
+		// Time of the last frame in milliseconds, tracing includes shading, denoising includes writing the screen
+		float GetTraceTime() const { return m_TraceTime; }
+		float GetDenoiseTime() const { return m_DenoiseTime; }
 
-		std::vector<uint16_t> m_YVals;
+	private:
 
 		enum class LightMode
 		{
@@ -63,6 +96,158 @@ namespace dae
 			{static_cast<int>(LightMode::BRDF),"BRDF"},
 		};
 
+		// Primary hit of a pixel, kept between frames so unchanged pixels don't have to be traced again
+		struct GBufferSample
+		{
+			Vector3 point{};
+			Vector3 normal{};
+			float t{ FLT_MAX };
+			int primitiveId{ -1 };
+			unsigned char materialIndex{ 0 };
+			bool didHit{ false };
+
+			// Bounds of everything the bounce rays touched (hit points and the lights they were shaded with)
+			Vector3 bounceMin{ FLT_MAX, FLT_MAX, FLT_MAX };
+			Vector3 bounceMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			bool bounceEscaped{ false };
+
+			// Shadow ray results of the primary hit, a bit per light
+			uint64_t lightVisibility{ 0 };
+			uint64_t lightVisibilityValid{ 0 };
+		};
+
+		enum class PixelState
+		{
+			Clean,		// Nothing that affects the pixel changed, the old color is kept
+			Reshade,	// Primary hit is still valid, only shading, shadow and bounce rays run again
+			Retrace		// Primary ray has to be traced again
+		};
+
+		struct ScreenRect
+		{
+			int minX{};
+			int minY{};
+			int maxX{};
+			int maxY{};
+		};
+
+		struct ObjectState
+		{
+			Vector3 min{};
+			Vector3 max{};
+			uint32_t version{};
+		};
+
+		// Everything of the previous frame that is needed to find out what changed
+		struct FrameState
+		{
+			uint64_t sceneGeneration{};
+			Vector3 cameraOrigin{};
+			Vector3 cameraForward{};
+			float cameraFov{};
+			LightMode lightMode{};
+			bool shadowsEnabled{};
+			std::vector<Light> lights{};
+			std::vector<ObjectState> objects{};
+		};
+
+		struct FrameChanges
+		{
+			bool retraceAll{ true };
+			bool reshadeAll{ false };
+
+			// Lights or geometry changed, also checked when the camera moved since the irradiance cache does not depend on it
+			bool sceneChanged{ true };
+
+			// Bit per light that moved, their cached shadows can't be used, all bits when shadows were just turned back on
+			uint64_t movedLights{ 0 };
+
+			// World bounds (old and new position combined) and screen bounds of every object that moved
+			std::vector<Vector3> movedMin{};
+			std::vector<Vector3> movedMax{};
+			std::vector<ScreenRect> movedRects{};
+		};
+
+		// Everything that stays the same for every pixel of a frame
+		struct FrameContext
+		{
+			const Scene* scenePtr{};
+			Vector3 cameraOrigin{};
+			Matrix cameraToWorld{};
+			float fovValue{};
+			float fieldOfViewTimesAspect{};
+			float multiplierXValue{};
+			float multiplierYValue{};
+			std::vector<Light> lights{};
+			std::vector<Material*> materials{};
+			FrameChanges changes{};
+		};
+
+		void Initialize();
+		void RenderTile(const FrameContext& context, uint32_t tileIndex);
+		void BuildRayTableTile(const FrameContext& context, uint32_t tileIndex);
+		void ResolveDenoisedTile(uint32_t tileIndex);
+		void ResolveTile(uint32_t tileIndex);
+		Frustum BuildTileFrustum(const FrameContext& context, int minX, int minY, int maxX, int maxY) const;
+
+		FrameChanges DetectChanges(const Scene* scenePtr, const Camera& camera, const Matrix& cameraToWorld);
+		ScreenRect ProjectBounds(const Vector3& min, const Vector3& max, const Camera& camera, const Matrix& cameraToWorld) const;
+		bool IsLightVisible(GBufferSample& sample, bool isPrimaryHit, size_t lightIndex, const Ray& hitToLightRay, const FrameContext& context) const;
+		PixelState GetPixelState(const GBufferSample& sample, int pixelX, int pixelY, const FrameChanges& changes, const std::vector<Light>& lights) const;
+
+
+		SDL_Window* m_pWindow{};
+
+		SDL_Surface* m_pBuffer{};
+		bool m_OwnsBuffer{ false };
+		uint32_t* m_pBufferPixels{};
+
+		int m_Width{};
+		int m_Height{};
+
+		// Shaded colors before they are turned into pixels, kept so pixels that are not traced again still have their color
+		std::vector<float> m_ColorR{};
+		std::vector<float> m_ColorG{};
+		std::vector<float> m_ColorB{};
+		PixelResolver m_PixelResolver{};
+
+		const float SHADOW_NORMAL_OFFSET{ 0.001f };
+
+		// Screen is split in square tiles, every tile culls the scene once for all of its primary rays
+		static constexpr int TILE_SIZE{ 16 };
+
+		// Lights past this amount are not cached and always cast their shadow rays
+		static constexpr size_t MAX_CACHED_LIGHTS{ 64 };
+		int m_TileCountX{};
+		int m_TileCountY{};
+		std::vector<uint32_t> m_TileIndices;
+
+		FrameContext m_FrameContext{};
+
+		// World space view ray direction of every pixel, split per axis so four pixels are made at once
+		// Only depends on the rotation and fov of the camera, so moving the camera keeps it
+		std::vector<float> m_RayDirectionX{};
+		std::vector<float> m_RayDirectionY{};
+		std::vector<float> m_RayDirectionZ{};
+		Vector3 m_RayTableRight{};
+		Vector3 m_RayTableUp{};
+		Vector3 m_RayTableForward{};
+		float m_RayTableFov{};
+		bool m_HasRayTable{ false };
+
+		std::vector<GBufferSample> m_GBuffer;
+		FrameState m_PreviousFrame{};
+		bool m_HasPreviousFrame{ false };
+		bool m_IncrementalEnabled{ true };
+
+		std::unique_ptr<Denoiser> m_pDenoiser{};
+		bool m_DenoiseEnabled{ false };
+
+		std::unique_ptr<IrradianceCache> m_pIrradianceCache{};
+		bool m_IrradianceEnabled{ false };
+		float m_TraceTime{};
+		float m_DenoiseTime{};
+
 		LightMode m_CurrentLightMode{ LightMode::Combined };
 		bool m_ShadowsEnabled{ true };
 		int interlaceState{};
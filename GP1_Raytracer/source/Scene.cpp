@@ -1,13 +1,18 @@
 #include "Scene.h"
+
+#include <random>
+
 #include "Utils.h"
 #include "Material.h"
+#include "Serialization.h"
 
 namespace dae {
 
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
 	Scene::Scene():
-		m_Materials({ new Material_SolidColor({1,0,0})})
+		m_Materials({ new Material_SolidColor({1,0,0})}),
+		m_Generation(s_NextGeneration++)
 	{
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
@@ -29,6 +34,7 @@ namespace dae {
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
 		HitRecord testHitRecord{};
+		int primitiveId{ 0 };
 
 		for (const Plane& plane : m_PlaneGeometries)
 		{
@@ -36,7 +42,12 @@ namespace dae {
 			GeometryUtils::HitTest_Plane(plane, ray, testHitRecord);
 
 			if (testHitRecord.t < closestHit.t)
+			{
 				closestHit = testHitRecord;
+				closestHit.primitiveId = primitiveId;
+			}
+
+			++primitiveId;
 		}
 
 		for (const Sphere& sphere : m_SphereGeometries)
@@ -45,7 +56,12 @@ namespace dae {
 			GeometryUtils::HitTest_Sphere(sphere, ray, testHitRecord);
 
 			if (testHitRecord.t < closestHit.t)
+			{
 				closestHit = testHitRecord;
+				closestHit.primitiveId = primitiveId;
+			}
+
+			++primitiveId;
 		}
 
 		for (const TriangleMesh& triangleMesh : m_TriangleMeshGeometries)
@@ -54,7 +70,74 @@ namespace dae {
 			GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray, testHitRecord);
 
 			if (testHitRecord.t < closestHit.t)
+			{
+				closestHit = testHitRecord;
+				closestHit.primitiveId = primitiveId;
+			}
+
+			++primitiveId;
+		}
+	}
+
+	void Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit, const GeometryCandidates& candidates) const
+	{
+		HitRecord testHitRecord{};
+
+		// Ids have to match the ones of the full test, so offset them the same way
+		const int sphereIdOffset{ static_cast<int>(m_PlaneGeometries.size()) };
+		const int meshIdOffset{ sphereIdOffset + static_cast<int>(m_SphereGeometries.size()) };
+
+		for (int planeIndex{}; planeIndex < static_cast<int>(m_PlaneGeometries.size()); ++planeIndex)
+		{
+			GeometryUtils::HitTest_Plane(m_PlaneGeometries[planeIndex], ray, testHitRecord);
+
+			if (testHitRecord.t < closestHit.t)
+			{
+				closestHit = testHitRecord;
+				closestHit.primitiveId = planeIndex;
+			}
+		}
+
+		for (const int sphereIndex : candidates.sphereIndices)
+		{
+			GeometryUtils::HitTest_Sphere(m_SphereGeometries[sphereIndex], ray, testHitRecord);
+
+			if (testHitRecord.t < closestHit.t)
+			{
+				closestHit = testHitRecord;
+				closestHit.primitiveId = sphereIdOffset + sphereIndex;
+			}
+		}
+
+		for (const int meshIndex : candidates.meshIndices)
+		{
+			GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[meshIndex], ray, testHitRecord);
+
+			if (testHitRecord.t < closestHit.t)
+			{
 				closestHit = testHitRecord;
+				closestHit.primitiveId = meshIdOffset + meshIndex;
+			}
+		}
+	}
+
+	void Scene::GetCandidates(const Frustum& frustum, GeometryCandidates& candidates) const
+	{
+		candidates.sphereIndices.clear();
+		candidates.meshIndices.clear();
+
+		for (int sphereIndex{}; sphereIndex < static_cast<int>(m_SphereGeometries.size()); ++sphereIndex)
+		{
+			if (GeometryUtils::IsInFrustum_Sphere(frustum, m_SphereGeometries[sphereIndex]))
+				candidates.sphereIndices.push_back(sphereIndex);
+		}
+
+		for (int meshIndex{}; meshIndex < static_cast<int>(m_TriangleMeshGeometries.size()); ++meshIndex)
+		{
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[meshIndex] };
+
+			if (GeometryUtils::IsInFrustum_AABB(frustum, mesh.transformedMinAABB, mesh.transformedMaxAABB))
+				candidates.meshIndices.push_back(meshIndex);
 		}
 	}
 
@@ -83,6 +166,71 @@ namespace dae {
 		return false;
 	}
 
+	void Scene::WriteFrameState(ByteWriter& writer) const
+	{
+		writer.Write(m_Camera.origin);
+		writer.Write(m_Camera.forward);
+		writer.Write(m_Camera.fovAngle);
+		writer.Write(m_Camera.cameraPitch);
+		writer.Write(m_Camera.cameraYaw);
+
+		writer.WriteVector(m_Lights);
+		writer.WriteVector(m_PlaneGeometries);
+		writer.WriteVector(m_SphereGeometries);
+
+		writer.Write(static_cast<uint32_t>(m_TriangleMeshGeometries.size()));
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			writer.WriteMatrix(mesh.rotationTransform);
+			writer.WriteMatrix(mesh.translationTransform);
+			writer.WriteMatrix(mesh.scaleTransform);
+		}
+	}
+
+	bool Scene::ReadFrameState(ByteReader& reader)
+	{
+		float fovAngle{};
+		if (!reader.Read(m_Camera.origin) || !reader.Read(m_Camera.forward) || !reader.Read(fovAngle) ||
+			!reader.Read(m_Camera.cameraPitch) || !reader.Read(m_Camera.cameraYaw))
+			return false;
+
+		m_Camera.targetOrigin = m_Camera.origin;
+		m_Camera.SetFOV(fovAngle);
+
+		if (!reader.ReadVector(m_Lights) || !reader.ReadVector(m_PlaneGeometries) || !reader.ReadVector(m_SphereGeometries))
+			return false;
+
+		// Both sides ran the same Initialize, so only the transforms of the meshes have to be sent
+		uint32_t meshCount{};
+		if (!reader.Read(meshCount) || meshCount != m_TriangleMeshGeometries.size())
+			return false;
+
+		for (TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			Matrix rotation{};
+			Matrix translation{};
+			Matrix scale{};
+			if (!reader.ReadMatrix(rotation) || !reader.ReadMatrix(translation) || !reader.ReadMatrix(scale))
+				return false;
+
+			const auto isSame = [](const Matrix& a, const Matrix& b)
+			{
+				return std::memcmp(&a, &b, sizeof(Matrix)) == 0;
+			};
+
+			// Rebuilding the transformed positions is expensive, skip it for meshes that did not move
+			if (isSame(rotation, mesh.rotationTransform) && isSame(translation, mesh.translationTransform) && isSame(scale, mesh.scaleTransform))
+				continue;
+
+			mesh.rotationTransform = rotation;
+			mesh.translationTransform = translation;
+			mesh.scaleTransform = scale;
+			mesh.UpdateTransforms();
+		}
+
+		return true;
+	}
+
 #pragma region Scene Helpers
 	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
 	{
@@ -426,4 +574,147 @@ namespace dae {
 
 		//m_SphereGeometries[6].origin = m_Camera.origin;
 	}
+
+	Scene_Stress::Scene_Stress(const StressSceneSettings& settings) :
+		m_Settings(settings)
+	{
+	}
+
+	void Scene_Stress::Initialize()
+	{
+		sceneName = "Stress";
+
+		// Everything random comes from this generator so the seed fully defines the scene
+		std::mt19937 generator{ m_Settings.seed };
+		std::uniform_real_distribution<float> random01{ 0.0f, 1.0f };
+		const auto randomRange = [&](float min, float max) { return min + random01(generator) * (max - min); };
+
+		const bool isCorridor{ m_Settings.distribution == StressDistribution::Corridor };
+		const float areaExtent{ 20.0f };
+		const float corridorHalfWidth{ 4.0f };
+		const float corridorLength{ 200.0f };
+
+		// Camera
+		if (isCorridor)
+		{
+			m_Camera.SetPosition({ 0.0f, 3.0f, -5.0f });
+			m_Camera.SetFOV(60.0f);
+		}
+		else
+		{
+			m_Camera.SetPosition({ 0.0f, 18.0f, -32.0f });
+			m_Camera.SetFOV(60.0f);
+			m_Camera.SetRotation(-30.0f, 0.0f);
+		}
+
+		// Materials, a small palette that all objects pick from
+		std::vector<unsigned char> palette{};
+		palette.push_back(AddMaterial(new Material_Lambert({ .49f, .57f, .57f }, 1.0f)));
+		palette.push_back(AddMaterial(new Material_Lambert({ .75f, .35f, .25f }, 1.0f)));
+		palette.push_back(AddMaterial(new Material_LambertPhong({ .25f, .45f, .75f }, 1.0f, 1.0f, 40.0f)));
+		palette.push_back(AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.0f, 0.3f)));
+		palette.push_back(AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, 0.0f, 0.6f)));
+		const auto randomMaterial = [&]() { return palette[static_cast<size_t>(random01(generator) * static_cast<float>(palette.size())) % palette.size()]; };
+
+		const auto groundMaterial = AddMaterial(new Material_Lambert({ .8f, .8f, .8f }, 1.0f));
+		GetMaterials()[groundMaterial]->m_globalRoughness = 1.0f;
+
+		// Walls
+		AddPlane(Vector3{ 0.0f, 0.0f, 0.0f }, Vector3{ 0.0f, 1.0f, 0.0f }, groundMaterial); //BOTTOM
+		if (isCorridor)
+		{
+			AddPlane(Vector3{ corridorHalfWidth, 0.0f, 0.0f }, Vector3{ -1.0f, 0.0f, 0.0f }, groundMaterial); //RIGHT
+			AddPlane(Vector3{ -corridorHalfWidth, 0.0f, 0.0f }, Vector3{ 1.0f, 0.0f, 0.0f }, groundMaterial); //LEFT
+		}
+
+		// Cluster centers are picked once so spheres, meshes and lights share them
+		constexpr int clusterCount{ 4 };
+		constexpr float clusterSpread{ 2.5f };
+		std::vector<Vector3> clusterCenters{};
+		for (int clusterIndex{}; clusterIndex < clusterCount; ++clusterIndex)
+			clusterCenters.emplace_back(randomRange(-areaExtent, areaExtent) * 0.7f, 0.0f, randomRange(-areaExtent, areaExtent) * 0.7f);
+
+		std::normal_distribution<float> clusterOffset{ 0.0f, clusterSpread };
+
+		// Returns a random point of the distribution, minHeight keeps objects above the floor
+		const auto randomPosition = [&](float minHeight, float maxHeight) -> Vector3
+		{
+			switch (m_Settings.distribution)
+			{
+			case StressDistribution::Clustered:
+			{
+				const Vector3& center{ clusterCenters[static_cast<size_t>(random01(generator) * clusterCount) % clusterCount] };
+				return { center.x + clusterOffset(generator), minHeight + std::abs(clusterOffset(generator)) * 0.5f, center.z + clusterOffset(generator) };
+			}
+			case StressDistribution::Corridor:
+				return { randomRange(-corridorHalfWidth + 0.5f, corridorHalfWidth - 0.5f), randomRange(minHeight, maxHeight), randomRange(0.0f, corridorLength) };
+			default:
+				return { randomRange(-areaExtent, areaExtent), randomRange(minHeight, maxHeight), randomRange(-areaExtent, areaExtent) };
+			}
+		};
+
+		// Spheres
+		m_SphereGeometries.reserve(m_Settings.sphereCount);
+		for (int sphereIndex{}; sphereIndex < m_Settings.sphereCount; ++sphereIndex)
+		{
+			const float radius{ randomRange(0.2f, 0.8f) };
+			AddSphere(randomPosition(radius, 6.0f), radius, randomMaterial());
+		}
+
+		// Meshes, every instance is a transformed copy of the same template mesh
+		std::vector<Vector3> templatePositions{};
+		std::vector<int> templateIndices{};
+		if (!Utils::ParseOBJ("Resources/simple_cube.obj", templatePositions, templateIndices))
+			std::cout << "Stress scene could not load the mesh template, no meshes are added\n";
+
+		if (!templatePositions.empty())
+		{
+			m_TriangleMeshGeometries.reserve(m_Settings.meshCount);
+			for (int meshIndex{}; meshIndex < m_Settings.meshCount; ++meshIndex)
+			{
+				TriangleMesh* pMesh{ AddTriangleMesh(TriangleCullMode::BackFaceCulling, randomMaterial()) };
+				pMesh->positions = templatePositions;
+				pMesh->indices = templateIndices;
+
+				const float scale{ randomRange(0.3f, 0.7f) };
+				pMesh->Scale({ scale, scale, scale });
+				pMesh->RotateY(randomRange(0.0f, PI_2));
+				pMesh->Translate(randomPosition(scale, 6.0f));
+
+				pMesh->UpdateAABB();
+				pMesh->UpdateTransforms();
+			}
+		}
+
+		// Lights, the total intensity stays about the same so the images are comparable between light counts
+		const int lightCount{ std::max(1, m_Settings.lightCount) };
+		const float lightIntensity{ 600.0f / static_cast<float>(lightCount) };
+		m_Lights.reserve(lightCount);
+		for (int lightIndex{}; lightIndex < lightCount; ++lightIndex)
+		{
+			const Vector3 lightPosition{ randomPosition(8.0f, 12.0f) };
+			const ColorRGB lightColor{ randomRange(0.6f, 1.0f), randomRange(0.6f, 1.0f), randomRange(0.6f, 1.0f) };
+			AddPointLight(lightPosition, lightIntensity, lightColor);
+		}
+	}
+
+	Scene* CreateScene(const std::string& sceneName, const StressSceneSettings& stressSettings)
+	{
+		if (sceneName == "raytracer")
+			return new Scene_Raytracer();
+
+		if (sceneName == "bunny")
+			return new Scene_Bunny();
+
+		if (sceneName == "car")
+			return new Scene_Car();
+
+		if (sceneName == "testing")
+			return new Scene_Testing();
+
+		if (sceneName == "stress")
+			return new Scene_Stress(stressSettings);
+
+		return nullptr;
+	}
 }
@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -10,6 +12,8 @@ namespace dae
 {
 	//Forward Declarations
 	class Timer;
+	class ByteWriter;
+	class ByteReader;
 	class Material;
 	struct Plane;
 	struct Sphere;
@@ -72,13 +76,23 @@ namespace dae
 
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+		void GetClosestHit(const Ray& ray, HitRecord& closestHit, const GeometryCandidates& candidates) const;
+		void GetCandidates(const Frustum& frustum, GeometryCandidates& candidates) const;
 		bool DoesHit(const Ray& ray) const;
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
+		const std::vector<TriangleMesh>& GetTriangleMeshGeometries() const { return m_TriangleMeshGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
 		const std::vector<Material*> GetMaterials() const { return m_Materials; }
 
+		// Different for every scene that is created, unlike its address which can be reused
+		uint64_t GetGeneration() const { return m_Generation; }
+
+		// Everything that can change after Initialize, used to mirror the scene in another process
+		void WriteFrameState(ByteWriter& writer) const;
+		bool ReadFrameState(ByteReader& reader);
+
 	protected:
 		std::string	sceneName;
 
@@ -98,6 +112,10 @@ namespace dae
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
 		unsigned char AddMaterial(Material* pMaterial);
+
+	private:
+		inline static std::atomic<uint64_t> s_NextGeneration{ 1 };	// Zero is never used, so it can mean no scene
+		uint64_t m_Generation;
 	};
 
 	class Scene_Bunny final : public Scene
@@ -166,4 +184,42 @@ namespace dae
 
 		std::vector<TriangleMesh*> m_Meshes;
 	};
+
+	enum class StressDistribution
+	{
+		Uniform,	// Everything spread evenly over a square area
+		Clustered,	// Everything packed around a few random cluster centers
+		Corridor,	// Everything spread along a long narrow corridor in front of the camera
+		COUNT
+	};
+
+	struct StressSceneSettings
+	{
+		int sphereCount{ 16 };
+		int meshCount{ 16 };
+		int lightCount{ 1 };
+		StressDistribution distribution{ StressDistribution::Uniform };
+		uint32_t seed{ 1337 };
+	};
+
+	// Procedural scene used to measure how the renderer scales, the same settings always give the same scene
+	class Scene_Stress final : public Scene
+	{
+	public:
+		Scene_Stress(const StressSceneSettings& settings);
+		~Scene_Stress() override = default;
+
+		Scene_Stress(const Scene_Stress&) = delete;
+		Scene_Stress(Scene_Stress&&) noexcept = delete;
+		Scene_Stress& operator=(const Scene_Stress&) = delete;
+		Scene_Stress& operator=(Scene_Stress&&) noexcept = delete;
+
+		void Initialize() override;
+
+	private:
+		StressSceneSettings m_Settings;
+	};
+
+	// Creates one of the scenes above by name (raytracer, bunny, car, testing, stress), nullptr when the name is unknown
+	Scene* CreateScene(const std::string& sceneName, const StressSceneSettings& stressSettings = {});
 }
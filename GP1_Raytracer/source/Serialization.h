@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Matrix.h"
+
+namespace dae
+{
+	// Appends plain values to a byte buffer, both sides are expected to run on the same kind of cpu
+	class ByteWriter final
+	{
+	public:
+		ByteWriter(std::vector<uint8_t>& data) : m_Data(data) {}
+
+		template<typename T>
+		void Write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be written as bytes");
+
+			const size_t offset{ m_Data.size() };
+			m_Data.resize(offset + sizeof(T));
+			std::memcpy(m_Data.data() + offset, &value, sizeof(T));
+		}
+
+		template<typename T>
+		void WriteVector(const std::vector<T>& values)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be written as bytes");
+
+			Write(static_cast<uint32_t>(values.size()));
+
+			const size_t offset{ m_Data.size() };
+			m_Data.resize(offset + values.size() * sizeof(T));
+			if (!values.empty())
+				std::memcpy(m_Data.data() + offset, values.data(), values.size() * sizeof(T));
+		}
+
+		void WriteString(const std::string& value)
+		{
+			WriteVector(std::vector<char>(value.begin(), value.end()));
+		}
+
+		void WriteMatrix(const Matrix& matrix)
+		{
+			for (int row{}; row < 4; ++row)
+				Write(matrix[row]);
+		}
+
+	private:
+		std::vector<uint8_t>& m_Data;
+	};
+
+	// Reads values back in the order they were written, stops reading once the data runs out
+	class ByteReader final
+	{
+	public:
+		ByteReader(const std::vector<uint8_t>& data) : m_Data(data) {}
+
+		template<typename T>
+		bool Read(T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be read from bytes");
+
+			if (m_Offset + sizeof(T) > m_Data.size())
+				return false;
+
+			std::memcpy(&value, m_Data.data() + m_Offset, sizeof(T));
+			m_Offset += sizeof(T);
+			return true;
+		}
+
+		template<typename T>
+		bool ReadVector(std::vector<T>& values)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be read from bytes");
+
+			uint32_t count{};
+			if (!Read(count) || m_Offset + static_cast<size_t>(count) * sizeof(T) > m_Data.size())
+				return false;
+
+			values.resize(count);
+			if (count > 0)
+				std::memcpy(values.data(), m_Data.data() + m_Offset, count * sizeof(T));
+
+			m_Offset += count * sizeof(T);
+			return true;
+		}
+
+		bool ReadString(std::string& value)
+		{
+			std::vector<char> characters{};
+			if (!ReadVector(characters))
+				return false;
+
+			value.assign(characters.begin(), characters.end());
+			return true;
+		}
+
+		bool ReadMatrix(Matrix& matrix)
+		{
+			for (int row{}; row < 4; ++row)
+			{
+				if (!Read(matrix[row]))
+					return false;
+			}
+
+			return true;
+		}
+
+	private:
+		const std::vector<uint8_t>& m_Data;
+		size_t m_Offset{};
+	};
+}
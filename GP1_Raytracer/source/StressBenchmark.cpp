@@ -0,0 +1,121 @@
+#include "StressBenchmark.h"
+
+//External includes
+#include "SDL.h"
+
+//Standard includes
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+//Project includes
+#include "Renderer.h"
+#include "Scene.h"
+
+namespace dae
+{
+	namespace
+	{
+		constexpr int WARMUP_FRAMES{ 2 };
+		constexpr int MEASURED_FRAMES{ 5 };
+
+		const char* GetDistributionName(StressDistribution distribution)
+		{
+			switch (distribution)
+			{
+			case StressDistribution::Uniform: return "Uniform";
+			case StressDistribution::Clustered: return "Clustered";
+			case StressDistribution::Corridor: return "Corridor";
+			default: return "Unknown";
+			}
+		}
+
+		float MeasureFrameTime(Renderer* pRenderer, const StressSceneSettings& settings)
+		{
+			Scene_Stress scene{ settings };
+			scene.Initialize();
+
+			for (int frameIndex{}; frameIndex < WARMUP_FRAMES; ++frameIndex)
+				pRenderer->Render(&scene);
+
+			const auto startTime{ std::chrono::high_resolution_clock::now() };
+			for (int frameIndex{}; frameIndex < MEASURED_FRAMES; ++frameIndex)
+				pRenderer->Render(&scene);
+			const auto endTime{ std::chrono::high_resolution_clock::now() };
+
+			// Keep the window responsive between runs
+			SDL_PumpEvents();
+
+			const std::chrono::duration<float, std::milli> totalTime{ endTime - startTime };
+			return totalTime.count() / static_cast<float>(MEASURED_FRAMES);
+		}
+	}
+
+	void RunStressBenchmark(Renderer* pRenderer, const std::string& outputPath, uint32_t seed)
+	{
+		// Every sweep grows one count over a few orders of magnitude while the others stay at their base value
+		const std::vector<int> sphereCounts{ 1, 4, 16, 64, 256, 1024 };
+		const std::vector<int> meshCounts{ 1, 4, 16, 64, 256 };
+		const std::vector<int> lightCounts{ 1, 2, 4, 8, 16, 32, 64 };
+
+		std::ofstream fileStream(outputPath);
+		if (!fileStream)
+		{
+			std::cout << std::format("Could not open {}, stress benchmark cancelled", outputPath) << std::endl;
+			return;
+		}
+
+		// Every frame has to be a full render, otherwise the reused pixels hide the real cost
+		pRenderer->SetIncrementalEnabled(false);
+
+		std::cout << "**STRESS BENCHMARK STARTED**\n";
+		fileStream << "distribution,sweep,spheres,meshes,lights,ms_per_frame" << std::endl;
+
+		const auto runPoint = [&](const char* sweepName, const StressSceneSettings& settings)
+		{
+			const float frameTime{ MeasureFrameTime(pRenderer, settings) };
+			const char* distributionName{ GetDistributionName(settings.distribution) };
+
+			std::cout << std::format(">> {} {}: spheres = {}, meshes = {}, lights = {} -> {:.2f} ms",
+				distributionName, sweepName, settings.sphereCount, settings.meshCount, settings.lightCount, frameTime) << std::endl;
+
+			fileStream << std::format("{},{},{},{},{},{:.3f}",
+				distributionName, sweepName, settings.sphereCount, settings.meshCount, settings.lightCount, frameTime) << std::endl;
+		};
+
+		for (int distributionIndex{}; distributionIndex < static_cast<int>(StressDistribution::COUNT); ++distributionIndex)
+		{
+			StressSceneSettings baseSettings{};
+			baseSettings.sphereCount = 1;
+			baseSettings.meshCount = 1;
+			baseSettings.lightCount = 1;
+			baseSettings.distribution = static_cast<StressDistribution>(distributionIndex);
+			baseSettings.seed = seed;
+
+			for (const int sphereCount : sphereCounts)
+			{
+				StressSceneSettings settings{ baseSettings };
+				settings.sphereCount = sphereCount;
+				runPoint("spheres", settings);
+			}
+
+			for (const int meshCount : meshCounts)
+			{
+				StressSceneSettings settings{ baseSettings };
+				settings.meshCount = meshCount;
+				runPoint("meshes", settings);
+			}
+
+			for (const int lightCount : lightCounts)
+			{
+				StressSceneSettings settings{ baseSettings };
+				settings.lightCount = lightCount;
+				runPoint("lights", settings);
+			}
+		}
+
+		std::cout << std::format("**STRESS BENCHMARK FINISHED** results written to {}", outputPath) << std::endl;
+	}
+}
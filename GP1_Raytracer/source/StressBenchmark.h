@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace dae
+{
+	class Renderer;
+
+	// Renders Scene_Stress across a range of sphere, mesh and light counts for every distribution
+	// and writes the average frame time of every run to a csv file, one scaling curve per sweep
+	void RunStressBenchmark(Renderer* pRenderer, const std::string& outputPath = "stress_benchmark.csv", uint32_t seed = 1337);
+}
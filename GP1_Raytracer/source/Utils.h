@@ -147,6 +147,71 @@ namespace dae
 			return HitTest_Triangle(triangle, ray, temp, true);
 		}
 #pragma endregion
+#pragma region AABB HitTest
+		//AABB HIT-TESTS
+		inline bool HitTest_AABB(const Vector3& min, const Vector3& max, const Ray& ray)
+		{
+			const float tx1 = (min.x - ray.origin.x) / ray.direction.x;
+			const float tx2 = (max.x - ray.origin.x) / ray.direction.x;
+
+			float tMin = std::min(tx1, tx2);
+			float tMax = std::max(tx1, tx2);
+
+			const float ty1 = (min.y - ray.origin.y) / ray.direction.y;
+			const float ty2 = (max.y - ray.origin.y) / ray.direction.y;
+
+			tMin = std::max(tMin, std::min(ty1, ty2));
+			tMax = std::min(tMax, std::max(ty1, ty2));
+
+			const float tz1 = (min.z - ray.origin.z) / ray.direction.z;
+			const float tz2 = (max.z - ray.origin.z) / ray.direction.z;
+
+			tMin = std::max(tMin, std::min(tz1, tz2));
+			tMax = std::min(tMax, std::max(tz1, tz2));
+
+			// Unlike the mesh test this one respects the ray bounds, so it can be used for segments
+			return tMax >= tMin && tMax >= ray.min && tMin <= ray.max;
+		}
+
+		inline bool Overlap_AABB(const Vector3& minA, const Vector3& maxA, const Vector3& minB, const Vector3& maxB)
+		{
+			return minA.x <= maxB.x && maxA.x >= minB.x &&
+				minA.y <= maxB.y && maxA.y >= minB.y &&
+				minA.z <= maxB.z && maxA.z >= minB.z;
+		}
+#pragma endregion
+#pragma region Frustum Tests
+		//FRUSTUM TESTS
+		inline bool IsInFrustum_Sphere(const Frustum& frustum, const Sphere& sphere)
+		{
+			for (const Vector3& normal : frustum.normals)
+			{
+				if (Vector3::Dot(sphere.origin - frustum.origin, normal) < -sphere.radius)
+					return false;
+			}
+
+			return true;
+		}
+
+		inline bool IsInFrustum_AABB(const Frustum& frustum, const Vector3& min, const Vector3& max)
+		{
+			for (const Vector3& normal : frustum.normals)
+			{
+				// Only the corner furthest along the normal has to be checked
+				const Vector3 furthestCorner
+				{
+					normal.x >= 0.0f ? max.x : min.x,
+					normal.y >= 0.0f ? max.y : min.y,
+					normal.z >= 0.0f ? max.z : min.z
+				};
+
+				if (Vector3::Dot(furthestCorner - frustum.origin, normal) < 0.0f)
+					return false;
+			}
+
+			return true;
+		}
+#pragma endregion
 #pragma region TriangeMesh HitTest
 
 		inline bool AABB_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
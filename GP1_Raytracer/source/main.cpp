@@ -1,16 +1,22 @@
 //External includes
+#ifdef _WIN32
 #include "vld.h"
+#endif
 #include "SDL.h"
 #include "SDL_surface.h"
 #undef main
 
 //Standard includes
 #include <iostream>
+#include <string>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
+#include "BatchRenderer.h"
+#include "DistributedRendering.h"
 #include "Scene.h"
+#include "StressBenchmark.h"
 
 using namespace dae;
 
@@ -22,9 +28,76 @@ void ShutDown(SDL_Window* pWindow)
 
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	// --stress-benchmark renders the procedural stress scenes, writes the scaling curves and exits
+	// --scene <name> picks the scene (raytracer, bunny, car, testing, stress)
+	// --coordinator <port> <workers> renders every frame on worker processes
+	// --worker <host> <port> renders tiles for a coordinator without opening a window
+	// --batch <file> <jobs> renders every view in the file to an image without opening a window
+	bool runStressBenchmark{ false };
+	std::string sceneName{ "testing" };
+	int coordinatorPort{ -1 };
+	int workerCount{ 0 };
+	std::string workerHost{};
+	int workerPort{ -1 };
+	std::string batchFile{};
+	int batchJobs{ 2 };
+
+	for (int argIndex{ 1 }; argIndex < argc; ++argIndex)
+	{
+		const std::string argument{ args[argIndex] };
+		const int argsLeft{ argc - argIndex - 1 };
+
+		if (argument == "--stress-benchmark")
+			runStressBenchmark = true;
+		else if (argument == "--scene" && argsLeft >= 1)
+			sceneName = args[++argIndex];
+		else if (argument == "--coordinator" && argsLeft >= 2)
+		{
+			coordinatorPort = std::stoi(args[++argIndex]);
+			workerCount = std::stoi(args[++argIndex]);
+		}
+		else if (argument == "--worker" && argsLeft >= 2)
+		{
+			workerHost = args[++argIndex];
+			workerPort = std::stoi(args[++argIndex]);
+		}
+		else if (argument == "--batch" && argsLeft >= 2)
+		{
+			batchFile = args[++argIndex];
+			batchJobs = std::stoi(args[++argIndex]);
+		}
+	}
+
+	if (workerPort >= 0)
+		return RunRenderWorker(workerHost, static_cast<uint16_t>(workerPort)) ? 0 : 1;
+
+	if (!batchFile.empty())
+	{
+		std::vector<BatchView> views{};
+		if (!BatchRenderer::LoadViews(batchFile, views))
+		{
+			std::cout << "Could not read " << batchFile << std::endl;
+			return 1;
+		}
+
+		// The scene is loaded once and shared by every view
+		Scene* pBatchScene{ CreateScene(sceneName) };
+		if (!pBatchScene)
+		{
+			std::cout << "Unknown scene " << sceneName << std::endl;
+			return 1;
+		}
+		pBatchScene->Initialize();
+
+		BatchRenderer batchRenderer{ pBatchScene, batchJobs };
+		for (const BatchView& view : views)
+			batchRenderer.AddView(view);
+
+		const bool allSaved{ batchRenderer.RenderAll() == static_cast<int>(views.size()) };
+
+		delete pBatchScene;
+		return allSaved ? 0 : 1;
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -48,17 +121,45 @@ int main(int argc, char* args[])
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
 
-	//const auto pScene = new Scene_Raytracer();
-	//const auto pScene = new Scene_Bunny();
-	//const auto pScene = new Scene_Car();
-	const auto pScene = new Scene_Testing();
+	if (runStressBenchmark)
+	{
+		RunStressBenchmark(pRenderer);
+
+		delete pRenderer;
+		delete pTimer;
+
+		ShutDown(pWindow);
+		return 0;
+	}
+
+	const auto pScene = CreateScene(sceneName);
+	if (!pScene)
+	{
+		std::cout << "Unknown scene " << sceneName << std::endl;
+
+		delete pRenderer;
+		delete pTimer;
+
+		ShutDown(pWindow);
+		return 1;
+	}
 	pScene->Initialize();
 
+	bool isLooping = true;
+
+	// Workers build the same scene on their side, after that only what changes is sent every frame
+	RenderCoordinator* pCoordinator{};
+	if (coordinatorPort >= 0)
+	{
+		pCoordinator = new RenderCoordinator(pRenderer, sceneName);
+		if (!pCoordinator->AcceptWorkers(static_cast<uint16_t>(coordinatorPort), workerCount))
+			isLooping = false;
+	}
+
 	//Start loop
 	pTimer->Start();
 
 	float printTimer = 0.f;
-	bool isLooping = true;
 	bool takeScreenshots = false;
 	while (isLooping)
 	{
@@ -84,9 +185,24 @@ int main(int argc, char* args[])
 				if (e.key.keysym.scancode == SDL_SCANCODE_F3)
 					pRenderer->CycleLightMode();
 
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+					pRenderer->ToggleIncremental();
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+					pRenderer->ToggleDenoiser();
+
 				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
 					pTimer->StartBenchmark();
 
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+					pRenderer->ToggleIrradianceCache();
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+					pRenderer->ToggleToneMapping();
+
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+					pRenderer->ToggleGammaCorrection();
+
 
 				break;
 			case SDL_MOUSEWHEEL:
@@ -103,7 +219,10 @@ int main(int argc, char* args[])
 		pScene->Update(pTimer);
 
 		//--------- Render ---------
-		pRenderer->Render(pScene);
+		if (pCoordinator)
+			isLooping = pCoordinator->RenderFrame(pScene) && isLooping;
+		else
+			pRenderer->Render(pScene);
 
 		//--------- Timer ---------
 		pTimer->Update();
@@ -112,6 +231,7 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			std::cout << "Trace: " << pRenderer->GetTraceTime() << " ms, Denoise: " << pRenderer->GetDenoiseTime() << " ms" << std::endl;
 		}
 
 		//Save screenshot after full render
@@ -127,6 +247,7 @@ int main(int argc, char* args[])
 	pTimer->Stop();
 
 	//Shutdown "framework"
+	delete pCoordinator;
 	delete pScene;
 	delete pRenderer;
 	delete pTimer;